@@ -0,0 +1,317 @@
+/*
+ * decompress.cpp: A plugin for the Video Disk Recorder
+ *
+ * See the README file for copyright information and how to reach the author.
+ *
+ */
+
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "xmltv2vdr.h"
+#include "decompress.h"
+#include "debug.h"
+
+cEPGDecompressor::cEPGDecompressor(cEPGSource *Source, xmlInputReadCallback ReadCallback, void *Context)
+{
+    source=Source;
+    readcallback=ReadCallback;
+    context=Context;
+    type=COMPRESSION_NONE;
+    detected=false;
+    inputeof=false;
+    finished=false;
+    failed=false;
+    ibuf=(unsigned char *) malloc(DECOMPRESSBUFSIZE);
+    ilen=0;
+    ipos=0;
+#ifdef HAVE_ZLIB
+    memset(&zs,0,sizeof(zs));
+    zsinit=false;
+#endif
+#ifdef HAVE_LZMA
+    lzma_stream tmp=LZMA_STREAM_INIT;
+    ls=tmp;
+    lsinit=false;
+#endif
+#ifdef HAVE_ZSTD
+    ds=NULL;
+    dsret=1;
+#endif
+}
+
+cEPGDecompressor::~cEPGDecompressor()
+{
+#ifdef HAVE_ZLIB
+    if (zsinit) inflateEnd(&zs);
+#endif
+#ifdef HAVE_LZMA
+    if (lsinit) lzma_end(&ls);
+#endif
+#ifdef HAVE_ZSTD
+    if (ds) ZSTD_freeDStream(ds);
+#endif
+    if (ibuf) free(ibuf);
+}
+
+int cEPGDecompressor::Compression(const char *Name)
+{
+    if (!Name) return COMPRESSION_NONE;
+    if ((!strcasecmp(Name,"gzip")) || (!strcasecmp(Name,"gz"))) return COMPRESSION_GZIP;
+    if (!strcasecmp(Name,"xz")) return COMPRESSION_XZ;
+    if ((!strcasecmp(Name,"zstd")) || (!strcasecmp(Name,"zst"))) return COMPRESSION_ZSTD;
+    return COMPRESSION_NONE;
+}
+
+const char *cEPGDecompressor::Name(int Compression)
+{
+    switch (Compression)
+    {
+    case COMPRESSION_GZIP:
+        return "gzip";
+    case COMPRESSION_XZ:
+        return "xz";
+    case COMPRESSION_ZSTD:
+        return "zstd";
+    default:
+        return "none";
+    }
+}
+
+const char *cEPGDecompressor::Suffix(int Compression)
+{
+    switch (Compression)
+    {
+    case COMPRESSION_GZIP:
+        return ".gz";
+    case COMPRESSION_XZ:
+        return ".xz";
+    case COMPRESSION_ZSTD:
+        return ".zst";
+    default:
+        return "";
+    }
+}
+
+int cEPGDecompressor::fail(const char *Reason)
+{
+    if (Reason) esyslogs(source,"failed to decompress xmltv (%s)",Reason);
+    failed=true;
+    return -1;
+}
+
+int cEPGDecompressor::fill()
+{
+    // returns 1 if input is available, 0 on eof and -1 on error
+    if (ipos<ilen) return 1;
+    ipos=ilen=0;
+    if (inputeof) return 0;
+    int n=readcallback(context,(char *) ibuf,DECOMPRESSBUFSIZE);
+    if (n<0) return -1;
+    if (!n)
+    {
+        inputeof=true;
+        return 0;
+    }
+    ilen=n;
+    return 1;
+}
+
+bool cEPGDecompressor::detect()
+{
+    // the magic bytes of all supported formats fit into 6 bytes
+    while ((ilen<6) && (!inputeof))
+    {
+        int n=readcallback(context,(char *) ibuf+ilen,DECOMPRESSBUFSIZE-ilen);
+        if (n<0) return false;
+        if (!n) inputeof=true;
+        ilen+=n;
+    }
+    detected=true;
+    if ((ilen>=2) && (ibuf[0]==0x1f) && (ibuf[1]==0x8b))
+    {
+        type=COMPRESSION_GZIP;
+    }
+    else if ((ilen>=6) && (!memcmp(ibuf,"\xfd" "7zXZ\0",6)))
+    {
+        type=COMPRESSION_XZ;
+    }
+    else if ((ilen>=4) && (!memcmp(ibuf,"\x28\xb5\x2f\xfd",4)))
+    {
+        type=COMPRESSION_ZSTD;
+    }
+    if (type!=COMPRESSION_NONE)
+    {
+        dsyslogs(source,"xmltv is %s compressed",Name(type));
+    }
+    return true;
+}
+
+bool cEPGDecompressor::init()
+{
+    switch (type)
+    {
+    case COMPRESSION_GZIP:
+#ifdef HAVE_ZLIB
+        // 16+MAX_WBITS: expect a gzip header
+        if (inflateInit2(&zs,16+MAX_WBITS)!=Z_OK)
+        {
+            fail(zs.msg ? zs.msg : "cannot initialize zlib");
+            return false;
+        }
+        zsinit=true;
+        return true;
+#else
+        break;
+#endif
+    case COMPRESSION_XZ:
+#ifdef HAVE_LZMA
+        if (lzma_stream_decoder(&ls,UINT64_MAX,LZMA_CONCATENATED)!=LZMA_OK)
+        {
+            fail("cannot initialize liblzma");
+            return false;
+        }
+        lsinit=true;
+        return true;
+#else
+        break;
+#endif
+    case COMPRESSION_ZSTD:
+#ifdef HAVE_ZSTD
+        ds=ZSTD_createDStream();
+        if ((!ds) || (ZSTD_isError(ZSTD_initDStream(ds))))
+        {
+            fail("cannot initialize libzstd");
+            return false;
+        }
+        return true;
+#else
+        break;
+#endif
+    default:
+        return true;
+    }
+    esyslogs(source,"%s compressed xmltv is not supported",Name(type));
+    fail(NULL);
+    return false;
+}
+
+int cEPGDecompressor::decompress(char *Buffer, int Len)
+{
+    if (finished) return 0;
+    switch (type)
+    {
+#ifdef HAVE_ZLIB
+    case COMPRESSION_GZIP:
+        zs.next_out=(Bytef *) Buffer;
+        zs.avail_out=Len;
+        while (zs.avail_out==(uInt) Len)
+        {
+            int r=fill();
+            if (r<0) return fail(NULL);
+            zs.next_in=ibuf+ipos;
+            zs.avail_in=ilen-ipos;
+            int ret=inflate(&zs,Z_NO_FLUSH);
+            ipos=ilen-zs.avail_in;
+            if (ret==Z_STREAM_END)
+            {
+                // gzip files may consist of several members
+                if ((r=fill())<0) return fail(NULL);
+                if (!r)
+                {
+                    finished=true;
+                    break;
+                }
+                inflateReset(&zs);
+                continue;
+            }
+            if ((ret==Z_BUF_ERROR) && (!r)) return fail("unexpected end of data");
+            if ((ret!=Z_OK) && (ret!=Z_BUF_ERROR)) return fail(zs.msg ? zs.msg : "data error");
+        }
+        return Len-zs.avail_out;
+#endif
+#ifdef HAVE_LZMA
+    case COMPRESSION_XZ:
+        ls.next_out=(uint8_t *) Buffer;
+        ls.avail_out=Len;
+        while (ls.avail_out==(size_t) Len)
+        {
+            int r=fill();
+            if (r<0) return fail(NULL);
+            ls.next_in=ibuf+ipos;
+            ls.avail_in=ilen-ipos;
+            lzma_ret ret=lzma_code(&ls,r ? LZMA_RUN : LZMA_FINISH);
+            ipos=ilen-ls.avail_in;
+            if (ret==LZMA_STREAM_END)
+            {
+                finished=true;
+                break;
+            }
+            if (ret==LZMA_BUF_ERROR) return fail("unexpected end of data");
+            if (ret!=LZMA_OK) return fail("data error");
+        }
+        return Len-ls.avail_out;
+#endif
+#ifdef HAVE_ZSTD
+    case COMPRESSION_ZSTD:
+    {
+        ZSTD_outBuffer out= { Buffer,(size_t) Len,0 };
+        for (;;)
+        {
+            int r=fill();
+            if (r<0) return fail(NULL);
+            ZSTD_inBuffer in= { ibuf,ilen,ipos };
+            dsret=ZSTD_decompressStream(ds,&out,&in);
+            ipos=in.pos;
+            if (ZSTD_isError(dsret)) return fail(ZSTD_getErrorName(dsret));
+            if (out.pos) break;
+            if ((!r) && (ipos>=ilen))
+            {
+                if (dsret) return fail("unexpected end of data");
+                finished=true;
+                break;
+            }
+        }
+        return (int) out.pos;
+    }
+#endif
+    default:
+        break;
+    }
+    return fail(NULL);
+}
+
+int cEPGDecompressor::Read(void *Context, char *Buffer, int Len)
+{
+    // xmlInputReadCallback, detects the compression by the magic bytes
+    // and passes uncompressed data through unchanged
+    cEPGDecompressor *dc=(cEPGDecompressor *) Context;
+    if (!dc) return -1;
+    if (dc->failed) return -1;
+    if (!dc->ibuf)
+    {
+        esyslogs(dc->source,"out of memory");
+        return dc->fail(NULL);
+    }
+    if (!dc->detected)
+    {
+        if (!dc->detect()) return dc->fail(NULL);
+        if (!dc->init()) return -1;
+    }
+    if (dc->type!=COMPRESSION_NONE) return dc->decompress(Buffer,Len);
+
+    if (dc->ipos<dc->ilen)
+    {
+        size_t n=dc->ilen-dc->ipos;
+        if (n>(size_t) Len) n=Len;
+        memcpy(Buffer,dc->ibuf+dc->ipos,n);
+        dc->ipos+=n;
+        return (int) n;
+    }
+    if (dc->inputeof) return 0;
+    int n=dc->readcallback(dc->context,Buffer,Len);
+    if (n<0) return dc->fail(NULL);
+    if (!n) dc->inputeof=true;
+    return n;
+}
@@ -0,0 +1,76 @@
+/*
+ * decompress.h: A plugin for the Video Disk Recorder
+ *
+ * See the README file for copyright information and how to reach the author.
+ *
+ */
+
+#ifndef _DECOMPRESS_H
+#define _DECOMPRESS_H
+
+#include <libxml/xmlIO.h>
+#include <stddef.h>
+
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef HAVE_LZMA
+#include <lzma.h>
+#endif
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+#define DECOMPRESSBUFSIZE 65536
+
+enum
+{
+    COMPRESSION_NONE=0,
+    COMPRESSION_GZIP,
+    COMPRESSION_XZ,
+    COMPRESSION_ZSTD
+};
+
+class cEPGSource;
+
+class cEPGDecompressor
+{
+private:
+    cEPGSource *source;
+    xmlInputReadCallback readcallback;
+    void *context;
+    int type;
+    bool detected;
+    bool inputeof;
+    bool finished;
+    bool failed;
+    unsigned char *ibuf;
+    size_t ilen;
+    size_t ipos;
+#ifdef HAVE_ZLIB
+    z_stream zs;
+    bool zsinit;
+#endif
+#ifdef HAVE_LZMA
+    lzma_stream ls;
+    bool lsinit;
+#endif
+#ifdef HAVE_ZSTD
+    ZSTD_DStream *ds;
+    size_t dsret;
+#endif
+    int fill();
+    bool detect();
+    bool init();
+    int decompress(char *Buffer, int Len);
+    int fail(const char *Reason);
+public:
+    cEPGDecompressor(cEPGSource *Source, xmlInputReadCallback ReadCallback, void *Context);
+    ~cEPGDecompressor();
+    static int Read(void *Context, char *Buffer, int Len);
+    static int Compression(const char *Name);
+    static const char *Name(int Compression);
+    static const char *Suffix(int Compression);
+};
+
+#endif
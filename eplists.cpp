@@ -0,0 +1,1366 @@
+/*
+ * eplists.cpp: A plugin for the Video Disk Recorder
+ *
+ * See the README file for copyright information and how to reach the author.
+ *
+ */
+
+#include <string.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include <libxml/xmlreader.h>
+
+#include "xmltv2vdr.h"
+#include "eplists.h"
+#include "parse.h"
+#include "debug.h"
+
+cEPLists EPLists;
+
+cEPList::cEPList(const char *File)
+{
+    file=strdup(File);
+    linkname=NULL;
+    dev=0;
+    ino=0;
+    fsize=0;
+    mtime=0;
+    mtimensec=0;
+    lastcheck=0;
+    episodes=NULL;
+    count=0;
+    keys=NULL;
+    seasonepisodes=NULL;
+    size=0;
+    strings=NULL;
+    stringsize=0;
+    stringalloc=0;
+    mapped=false;
+    memory=sizeof(cEPList);
+    lastseason=lastepisode=lastoverall=0;
+    lastset=0;
+    tgcodes=NULL;
+    tgstart=NULL;
+    tgentries=NULL;
+    tgsizes=NULL;
+    tgcount=0;
+    tgbuilt=false;
+}
+
+cEPList::~cEPList()
+{
+    if (!mapped)
+    {
+        free(episodes);
+        free(keys);
+        free(seasonepisodes);
+        free(strings);
+    }
+    free(tgcodes);
+    free(tgstart);
+    free(tgentries);
+    free(tgsizes);
+    free(linkname);
+    free(file);
+}
+
+unsigned int cEPList::hash(const char *Key, int Len)
+{
+    // FNV-1a
+    unsigned int h=2166136261U;
+    for (int i=0; i<Len; i++)
+    {
+        h^=(unsigned char) Key[i];
+        h*=16777619U;
+    }
+    return h;
+}
+
+unsigned int cEPList::hash(int Season, int Episode)
+{
+    unsigned int h=(unsigned int) Season*2654435761U;
+    h^=(unsigned int) Episode+0x9e3779b9U+(h<<6)+(h>>2);
+    return h;
+}
+
+int cEPList::findkey(const char *Key, int Len, unsigned int Hash)
+{
+    if (!size) return -1;
+    for (unsigned int i=Hash & (size-1); keys[i]!=-1; i=(i+1) & (size-1))
+    {
+        struct episode *e=&episodes[keys[i]];
+        if ((e->len==Len) && (!memcmp(strings+e->key,Key,Len))) return keys[i];
+    }
+    return -1;
+}
+
+int cEPList::findseasonepisode(int Season, int Episode)
+{
+    if (!size) return -1;
+    for (unsigned int i=hash(Season,Episode) & (size-1); seasonepisodes[i]!=-1; i=(i+1) & (size-1))
+    {
+        struct episode *e=&episodes[seasonepisodes[i]];
+        if ((e->season==Season) && (e->episode==Episode)) return seasonepisodes[i];
+    }
+    return -1;
+}
+
+int cEPList::addstring(const char *String)
+{
+    int len=strlen(String)+1;
+    if (stringsize+len>stringalloc)
+    {
+        int nalloc=stringalloc ? stringalloc : 4096;
+        while (stringsize+len>nalloc) nalloc*=2;
+        char *nstrings=(char *) realloc(strings,nalloc);
+        if (!nstrings) return -1;
+        strings=nstrings;
+        stringalloc=nalloc;
+    }
+    int offset=stringsize;
+    memcpy(strings+offset,String,len);
+    stringsize+=len;
+    return offset;
+}
+
+bool cEPList::add(int Season, int Episode, int Overall, const char *Text, const char *Key)
+{
+    if (!(count & 63))
+    {
+        struct episode *nepisodes=(struct episode *) realloc(episodes,(count+64)*sizeof(struct episode));
+        if (!nepisodes) return false;
+        episodes=nepisodes;
+    }
+    struct episode *e=&episodes[count];
+    e->season=Season;
+    e->episode=Episode;
+    e->overall=Overall;
+    e->text=addstring(Text);
+    if (e->text==-1) return false;
+    e->key=addstring(Key);
+    if (e->key==-1) return false;
+    e->len=strlen(Key);
+    char *key=strings+e->key;
+    for (int i=0; i<e->len; i++) key[i]=tolower((unsigned char) key[i]);
+    count++;
+    return true;
+}
+
+bool cEPList::addepisode(iconv_t Conv, int Season, int Episode, int Overall, const char *Text)
+{
+    // adds the shorttext with its normalized key, texts which cannot be
+    // converted are skipped
+    char depshorttext[1024]="";
+    size_t slen=strlen(Text);
+    size_t dlen=sizeof(depshorttext);
+    char *FromPtr=(char *) Text;
+    char *ToPtr=(char *) depshorttext;
+    if (iconv(Conv,&FromPtr,&slen,&ToPtr,&dlen)==(size_t) -1)
+    {
+        tsyslog("failed to convert '%s'->'%s' (2)",Text,depshorttext);
+        return true;
+    }
+    cParse::RemoveNonAlphaNumeric(depshorttext);
+    if (!strlen(depshorttext))
+    {
+        strcpy(depshorttext,Text); // ok lets try with the original text
+    }
+    return add(Season,Episode,Overall,Text,depshorttext);
+}
+
+bool cEPList::loadxml(int Fd)
+{
+    // TheTVDB series xml, the texts are always UTF-8
+    iconv_t cutf2ascii=iconv_open("ASCII//TRANSLIT","UTF-8");
+    if (cutf2ascii==(iconv_t) -1) return false;
+    xmlTextReaderPtr reader=xmlReaderForFd(Fd,file,NULL,XML_PARSE_NONET|XML_PARSE_NOERROR|
+                                           XML_PARSE_NOWARNING);
+    if (!reader)
+    {
+        iconv_close(cutf2ascii);
+        return false;
+    }
+    bool ok=true;
+    bool skipsubtree=false;
+    int ret;
+    while ((ret=(skipsubtree ? xmlTextReaderNext(reader) : xmlTextReaderRead(reader)))==1)
+    {
+        skipsubtree=false;
+        if (xmlTextReaderNodeType(reader)!=XML_READER_TYPE_ELEMENT) continue;
+        if (!xmlTextReaderDepth(reader)) continue;
+        skipsubtree=true;
+        if (xmlStrcmp(xmlTextReaderConstName(reader),(const xmlChar *) "Episode")) continue;
+        xmlNodePtr node=xmlTextReaderExpand(reader);
+        if (!node) continue;
+
+        int season=0,episode=0,overall=0;
+        char epshorttext[256]="";
+        for (xmlNodePtr vnode=node->xmlChildrenNode; vnode; vnode=vnode->next)
+        {
+            if (vnode->type!=XML_ELEMENT_NODE) continue;
+            xmlChar *content=xmlNodeListGetString(vnode->doc,vnode->xmlChildrenNode,1);
+            if (!content) continue;
+            if (!xmlStrcmp(vnode->name,(const xmlChar *) "SeasonNumber"))
+            {
+                season=atoi((const char *) content);
+            }
+            else if (!xmlStrcmp(vnode->name,(const xmlChar *) "EpisodeNumber"))
+            {
+                episode=atoi((const char *) content);
+            }
+            else if (!xmlStrcmp(vnode->name,(const xmlChar *) "absolute_number"))
+            {
+                overall=atoi((const char *) content);
+            }
+            else if (!xmlStrcmp(vnode->name,(const xmlChar *) "EpisodeName"))
+            {
+                strn0cpy(epshorttext,(const char *) content,sizeof(epshorttext));
+            }
+            xmlFree(content);
+        }
+        lastseason=season;
+        lastepisode=episode;
+        lastoverall=overall;
+        lastset=7;
+        compactspace(epshorttext);
+        if (!epshorttext[0]) continue;
+        if (!addepisode(cutf2ascii,season,episode,overall,epshorttext))
+        {
+            ok=false;
+            break;
+        }
+    }
+    if (ret==-1)
+    {
+        esyslog("failed to parse %s",file);
+        ok=false;
+    }
+    xmlFreeTextReader(reader);
+    iconv_close(cutf2ascii);
+    return ok;
+}
+
+bool cEPList::index()
+{
+    // both tables only hold the first episode in the file for each key,
+    // Match() relies on this
+    size=64;
+    while (size<count*2) size*=2;
+    keys=(int *) malloc(size*sizeof(int));
+    seasonepisodes=(int *) malloc(size*sizeof(int));
+    if ((!keys) || (!seasonepisodes)) return false;
+    memset(keys,-1,size*sizeof(int));
+    memset(seasonepisodes,-1,size*sizeof(int));
+    for (int n=0; n<count; n++)
+    {
+        struct episode *e=&episodes[n];
+        unsigned int h=hash(strings+e->key,e->len);
+        if (findkey(strings+e->key,e->len,h)==-1)
+        {
+            unsigned int i=h & (size-1);
+            while (keys[i]!=-1) i=(i+1) & (size-1);
+            keys[i]=n;
+        }
+        if (findseasonepisode(e->season,e->episode)==-1)
+        {
+            unsigned int i=hash(e->season,e->episode) & (size-1);
+            while (seasonepisodes[i]!=-1) i=(i+1) & (size-1);
+            seasonepisodes[i]=n;
+        }
+    }
+    memory+=count*sizeof(struct episode)+2*size*sizeof(int)+stringalloc;
+    return true;
+}
+
+bool cEPList::Load(iconv_t cEP2ASCII)
+{
+    if (!file) return false;
+    FILE *f=fopen(file,"r");
+    if (!f) return false;
+
+    struct stat statbuf;
+    if (fstat(fileno(f),&statbuf)==-1)
+    {
+        fclose(f);
+        return false;
+    }
+    dev=statbuf.st_dev;
+    ino=statbuf.st_ino;
+    fsize=statbuf.st_size;
+    mtime=statbuf.st_mtim.tv_sec;
+    mtimensec=statbuf.st_mtim.tv_nsec;
+    lastcheck=time(NULL);
+
+    char dname[2048]="";
+    if (readlink(file,dname,sizeof(dname)-1)!=-1)
+    {
+        char *ls=strrchr(dname,'/');
+        if (ls)
+        {
+            ls++;
+            memmove(dname,ls,strlen(ls)+1);
+        }
+        char *pt=strrchr(dname,'.');
+        if (pt)
+        {
+            *pt=0;
+            linkname=strdup(dname);
+        }
+    }
+
+    size_t flen=strlen(file);
+    if ((flen>=strlen(EPXMLSUFFIX)) && (!strcmp(file+flen-strlen(EPXMLSUFFIX),EPXMLSUFFIX)))
+    {
+        bool ok=loadxml(fileno(f));
+        fclose(f);
+        if (!ok) return false;
+        return index();
+    }
+
+    char *line=NULL;
+    size_t length=0;
+    bool ok=true;
+    while (getline(&line,&length,f)!=-1)
+    {
+        if (line==NULL)
+        {
+            length=0;
+            continue;
+        }
+        if (line[0]=='#') continue;
+        int season,episode,overall;
+        char epshorttext[256]="";
+        int r=sscanf(line,"%3d\t%3d\t%5d\t%255c",&season,&episode,&overall,epshorttext);
+        // sscanf assigns the fields up to the first mismatch
+        if (r>=1)
+        {
+            lastseason=season;
+            lastset|=1;
+        }
+        if (r>=2)
+        {
+            lastepisode=episode;
+            lastset|=2;
+        }
+        if (r>=3)
+        {
+            lastoverall=overall;
+            lastset|=4;
+        }
+        if (r!=4)
+        {
+            tsyslog("failed to parse '%s' in '%s'",line,file);
+            continue;
+        }
+        char *lf=strchr(epshorttext,'\n');
+        if (lf) *lf=0;
+        char *tab=strchr(epshorttext,'\t');
+        if (tab) *tab=0;
+        if (!addepisode(cEP2ASCII,season,episode,overall,epshorttext))
+        {
+            ok=false;
+            break;
+        }
+    }
+    if (line) free(line);
+    fclose(f);
+    if (!ok) return false;
+    return index();
+}
+
+#define EPALIGN(x) (((x)+7) & ~((size_t) 7))
+
+const char *cEPList::RecordName(const void *Record, size_t Len)
+{
+    const struct record *r=(const struct record *) Record;
+    if ((Len<sizeof(struct record)) || (r->reclen>Len) || (!r->namelen) ||
+            (sizeof(struct record)+r->namelen>r->reclen)) return NULL;
+    const char *name=(const char *) Record+sizeof(struct record);
+    if (name[r->namelen-1]) return NULL;
+    return name;
+}
+
+bool cEPList::Map(const void *Record, size_t Len)
+{
+    // use the data in the index without copying, the index must stay
+    // mapped as long as this list exists
+    if (!RecordName(Record,Len)) return false;
+    const struct record *r=(const struct record *) Record;
+    if ((r->count<0) || (r->size<=0) || (r->size & (r->size-1)) ||
+            (r->count>r->size/2) || (r->reclen>Len)) return false;
+    size_t pos=EPALIGN(sizeof(struct record)+r->namelen+r->linknamelen);
+    size_t need=pos+r->count*sizeof(struct episode)+2*r->size*sizeof(int)+r->stringsize;
+    if (need>r->reclen) return false;
+
+    const char *data=(const char *) Record;
+    if (r->linknamelen)
+    {
+        if (data[sizeof(struct record)+r->namelen+r->linknamelen-1]) return false;
+        linkname=strdup(data+sizeof(struct record)+r->namelen);
+    }
+    episodes=(struct episode *)(data+pos);
+    pos+=r->count*sizeof(struct episode);
+    keys=(int *)(data+pos);
+    pos+=r->size*sizeof(int);
+    seasonepisodes=(int *)(data+pos);
+    pos+=r->size*sizeof(int);
+    strings=(char *)(data+pos);
+    count=r->count;
+    size=r->size;
+    stringsize=stringalloc=r->stringsize;
+    lastseason=r->lastseason;
+    lastepisode=r->lastepisode;
+    lastoverall=r->lastoverall;
+    lastset=r->lastset;
+    dev=(dev_t) r->dev;
+    ino=(ino_t) r->ino;
+    fsize=(off_t) r->fsize;
+    mtime=(time_t) r->mtime;
+    mtimensec=(long) r->mtimensec;
+    lastcheck=0;
+    mapped=true;
+
+    for (int i=0; i<count; i++)
+    {
+        struct episode *e=&episodes[i];
+        if ((e->text<0) || (e->text>=stringsize) || (e->key<0) || (e->len<0) ||
+                (e->key+e->len>=stringsize) || (strings[e->key+e->len]) ||
+                (!memchr(strings+e->text,0,stringsize-e->text)))
+        {
+            count=size=0;
+            return false;
+        }
+    }
+    for (int i=0; i<size; i++)
+    {
+        if ((keys[i]<-1) || (keys[i]>=count) || (seasonepisodes[i]<-1) ||
+                (seasonepisodes[i]>=count))
+        {
+            count=size=0;
+            return false;
+        }
+    }
+    return true;
+}
+
+bool cEPList::Write(FILE *File, const char *Name)
+{
+    if ((!File) || (!Name)) return false;
+    struct record r;
+    memset(&r,0,sizeof(r));
+    r.namelen=strlen(Name)+1;
+    r.linknamelen=linkname ? strlen(linkname)+1 : 0;
+    r.count=count;
+    r.size=size;
+    r.lastseason=lastseason;
+    r.lastepisode=lastepisode;
+    r.lastoverall=lastoverall;
+    r.lastset=lastset;
+    r.stringsize=stringsize;
+    r.dev=(uint64_t) dev;
+    r.ino=(uint64_t) ino;
+    r.fsize=(int64_t) fsize;
+    r.mtime=(int64_t) mtime;
+    r.mtimensec=(int64_t) mtimensec;
+    size_t head=sizeof(r)+r.namelen+r.linknamelen;
+    size_t len=EPALIGN(head)+count*sizeof(struct episode)+2*size*sizeof(int)+stringsize;
+    r.reclen=EPALIGN(len);
+
+    static const char zero[8]= { 0 };
+    if (fwrite(&r,sizeof(r),1,File)!=1) return false;
+    if (fwrite(Name,r.namelen,1,File)!=1) return false;
+    if ((linkname) && (fwrite(linkname,r.linknamelen,1,File)!=1)) return false;
+    if ((EPALIGN(head)>head) && (fwrite(zero,EPALIGN(head)-head,1,File)!=1)) return false;
+    if ((count) && (fwrite(episodes,sizeof(struct episode),count,File)!=(size_t) count)) return false;
+    if (fwrite(keys,sizeof(int),size,File)!=(size_t) size) return false;
+    if (fwrite(seasonepisodes,sizeof(int),size,File)!=(size_t) size) return false;
+    if ((stringsize) && (fwrite(strings,stringsize,1,File)!=1)) return false;
+    if ((r.reclen>len) && (fwrite(zero,r.reclen-len,1,File)!=1)) return false;
+    return !ferror(File);
+}
+
+bool cEPList::Changed(time_t Now)
+{
+    // the file is checked for changes at most every EPLISTSCHECK seconds
+    if (Now-lastcheck<EPLISTSCHECK) return false;
+    lastcheck=Now;
+    struct stat statbuf;
+    if (stat(file,&statbuf)==-1) return true;
+    if ((statbuf.st_dev!=dev) || (statbuf.st_ino!=ino) || (statbuf.st_size!=fsize) ||
+            (statbuf.st_mtim.tv_sec!=mtime) || (statbuf.st_mtim.tv_nsec!=mtimensec)) return true;
+    return false;
+}
+
+bool cEPList::Match(const char *ShortText, int FSeason, int FEpisode, int &Season, int &Episode,
+                    int &EpisodeOverall, char **EPShortText, bool *NotNamed)
+{
+    // same result as comparing ShortText with each line of the file: the
+    // first exact or season/episode match wins, otherwise the first of
+    // the longest shorttexts in the file which start ShortText
+    if (NotNamed) *NotNamed=false;
+    if (EPShortText) *EPShortText=NULL;
+
+    int len=strlen(ShortText);
+    char *key=strdup(ShortText);
+    if (!key) return false;
+    for (int i=0; i<len; i++) key[i]=tolower((unsigned char) key[i]);
+
+    // the lines up to "last" are looked at
+    int exact=findkey(key,len,hash(key,len));
+    int se=findseasonepisode(FSeason,FEpisode);
+    int last=count-1;
+    bool matched=false;
+    if ((exact!=-1) && ((se==-1) || (exact<=se)))
+    {
+        last=exact-1;
+        matched=true;
+        se=-1;
+    }
+    else if (se!=-1)
+    {
+        last=se;
+        matched=true;
+        exact=-1;
+    }
+
+    // prefixes are hashed incrementally, the longest one wins
+    int best=-1;
+    unsigned int h=2166136261U;
+    for (int i=0; i<len-1; i++)
+    {
+        h^=(unsigned char) key[i];
+        h*=16777619U;
+        int n=findkey(key,i+1,h);
+        if ((n!=-1) && (n<=last)) best=n;
+    }
+    free(key);
+
+    if (matched)
+    {
+        struct episode *e=&episodes[exact!=-1 ? exact : se];
+        Season=e->season;
+        Episode=e->episode;
+        EpisodeOverall=e->overall;
+        if ((se!=-1) && (!strcasecmp(strings+e->text,"n.n.")))
+        {
+            if (EPShortText) *EPShortText=strdup("@");
+            if (NotNamed) *NotNamed=true;
+        }
+        else
+        {
+            if (EPShortText) *EPShortText=strdup(strings+e->text);
+        }
+    }
+    else
+    {
+        if (lastset & 1) Season=lastseason;
+        if (lastset & 2) Episode=lastepisode;
+        if (lastset & 4) EpisodeOverall=lastoverall;
+        if ((best!=-1) && (EPShortText)) *EPShortText=strdup(strings+episodes[best].text);
+    }
+    if ((best!=-1) && (EPShortText) && (episodes[best].episode!=-1))
+    {
+        Season=episodes[best].season;
+        Episode=episodes[best].episode;
+        EpisodeOverall=episodes[best].overall;
+    }
+    return (matched || best!=-1);
+}
+
+static int compareuint32(const void *a, const void *b)
+{
+    uint32_t x=*(const uint32_t *) a,y=*(const uint32_t *) b;
+    return (x>y)-(x<y);
+}
+
+static int compareuint64(const void *a, const void *b)
+{
+    uint64_t x=*(const uint64_t *) a,y=*(const uint64_t *) b;
+    return (x>y)-(x<y);
+}
+
+static bool samedigits(const char *a, const char *b)
+{
+    // "Teil 1" and "Teil 2" are different episodes, even if similar
+    for (;;)
+    {
+        while ((*a) && (!isdigit((unsigned char) *a))) a++;
+        while ((*b) && (!isdigit((unsigned char) *b))) b++;
+        if (*a!=*b) return false;
+        if (!*a) return true;
+        a++;
+        b++;
+    }
+}
+
+int cEPList::trigrams(const char *Key, int Len, uint32_t *Codes)
+{
+    // distinct trigrams of the key with two start and one end marker,
+    // Codes must have room for Len+1 entries
+    int n=0;
+    uint32_t code=0x0101;
+    for (int i=0; i<=Len; i++)
+    {
+        unsigned char c=(i<Len) ? (unsigned char) Key[i] : 2;
+        code=((code<<8) | c) & 0xffffff;
+        Codes[n++]=code;
+    }
+    qsort(Codes,n,sizeof(uint32_t),compareuint32);
+    int u=0;
+    for (int i=0; i<n; i++)
+    {
+        if ((!u) || (Codes[u-1]!=Codes[i])) Codes[u++]=Codes[i];
+    }
+    return u;
+}
+
+bool cEPList::buildtrigrams()
+{
+    // posting lists of all distinct keys, sorted by trigram
+    tgbuilt=true;
+    if (!count) return false;
+    tgsizes=(int *) calloc(count,sizeof(int));
+    if (!tgsizes) return false;
+    int total=0;
+    for (int n=0; n<count; n++)
+    {
+        struct episode *e=&episodes[n];
+        if (findkey(strings+e->key,e->len,hash(strings+e->key,e->len))!=n) continue;
+        total+=e->len+1;
+    }
+    uint64_t *pairs=(uint64_t *) malloc(total*sizeof(uint64_t));
+    uint32_t *codes=(uint32_t *) malloc((stringsize+1)*sizeof(uint32_t));
+    if ((!pairs) || (!codes))
+    {
+        free(pairs);
+        free(codes);
+        return false;
+    }
+    int npairs=0;
+    for (int n=0; n<count; n++)
+    {
+        struct episode *e=&episodes[n];
+        if (findkey(strings+e->key,e->len,hash(strings+e->key,e->len))!=n) continue;
+        int c=trigrams(strings+e->key,e->len,codes);
+        for (int i=0; i<c; i++) pairs[npairs++]=((uint64_t) codes[i]<<32) | (uint32_t) n;
+        tgsizes[n]=c;
+    }
+    free(codes);
+    qsort(pairs,npairs,sizeof(uint64_t),compareuint64);
+
+    tgcodes=(uint32_t *) malloc(npairs*sizeof(uint32_t));
+    tgstart=(int *) malloc((npairs+1)*sizeof(int));
+    tgentries=(int *) malloc(npairs*sizeof(int));
+    if ((!tgcodes) || (!tgstart) || (!tgentries))
+    {
+        free(pairs);
+        return false;
+    }
+    for (int i=0; i<npairs; i++)
+    {
+        uint32_t code=(uint32_t)(pairs[i]>>32);
+        if ((!tgcount) || (tgcodes[tgcount-1]!=code))
+        {
+            tgcodes[tgcount]=code;
+            tgstart[tgcount++]=i;
+        }
+        tgentries[i]=(int)(pairs[i] & 0xffffffff);
+    }
+    tgstart[tgcount]=npairs;
+    free(pairs);
+    memory+=count*sizeof(int)+npairs*(sizeof(uint32_t)+2*sizeof(int))+sizeof(int);
+    return true;
+}
+
+int cEPList::Fuzzy(const char *ShortText, int Threshold, int *Score)
+{
+    // line with the most trigrams in common (Dice coefficient in percent),
+    // the first one of equally good lines wins
+    *Score=0;
+    int len=strlen(ShortText);
+    if ((Threshold<=0) || (len<EPLISTSFUZZYMIN)) return -1;
+    if (!tgbuilt) buildtrigrams();
+    if (!tgcount) return -1;
+
+    char *key=strdup(ShortText);
+    uint32_t *codes=(uint32_t *) malloc((len+1)*sizeof(uint32_t));
+    int *common=(int *) calloc(count,sizeof(int));
+    int *candidates=(int *) malloc(count*sizeof(int));
+    int best=-1,bestscore=0;
+    if ((key) && (codes) && (common) && (candidates))
+    {
+        for (int i=0; i<len; i++) key[i]=tolower((unsigned char) key[i]);
+        int c=trigrams(key,len,codes);
+
+        int ncandidates=0;
+        for (int i=0; i<c; i++)
+        {
+            uint32_t *t=(uint32_t *) bsearch(&codes[i],tgcodes,tgcount,sizeof(uint32_t),compareuint32);
+            if (!t) continue;
+            int x=t-tgcodes;
+            for (int j=tgstart[x]; j<tgstart[x+1]; j++)
+            {
+                int n=tgentries[j];
+                if (!common[n]++) candidates[ncandidates++]=n;
+            }
+        }
+
+        for (int i=0; i<ncandidates; i++)
+        {
+            int n=candidates[i];
+            int score=(200*common[n])/(c+tgsizes[n]);
+            if ((score<Threshold) || (score<bestscore)) continue;
+            if ((score==bestscore) && (n>best)) continue;
+            if (!samedigits(key,strings+episodes[n].key)) continue;
+            best=n;
+            bestscore=score;
+        }
+    }
+    free(key);
+    free(codes);
+    free(common);
+    free(candidates);
+    *Score=bestscore;
+    if (bestscore<Threshold) return -1;
+    return best;
+}
+
+bool cEPList::Get(int Number, int &Season, int &Episode, int &EpisodeOverall, char **EPShortText)
+{
+    if ((Number<0) || (Number>=count)) return false;
+    struct episode *e=&episodes[Number];
+    Season=e->season;
+    Episode=e->episode;
+    EpisodeOverall=e->overall;
+    if (EPShortText) *EPShortText=strdup(strings+e->text);
+    return true;
+}
+
+// -------------------------------------------------------
+
+cEPLists::cEPLists()
+{
+    dir=NULL;
+    mtime=0;
+    mtimensec=0;
+    lastcheck=0;
+    loaded=false;
+    lists=NULL;
+    size=0;
+    count=0;
+    cachesize=0;
+    maxcachesize=EPLISTSCACHE*1024*1024;
+    fuzzy=EPLISTSFUZZY;
+    fuzzyqueries=0;
+    fuzzyhits=0;
+    fuzzytime=0;
+    indexfile=NULL;
+    indexdir=NULL;
+    indexcodeset=NULL;
+    indexchecked=false;
+    index=NULL;
+    indexsize=0;
+    offsets=NULL;
+    indexcount=0;
+}
+
+cEPLists::~cEPLists()
+{
+    clear();
+    if (dir) free(dir);
+    cache.Clear();
+    unmapindex();
+    free(indexfile);
+    free(indexdir);
+    free(indexcodeset);
+}
+
+void cEPLists::clear()
+{
+    for (int i=0; i<size; i++)
+    {
+        if (!lists[i].lname) continue;
+        free(lists[i].lname);
+        free(lists[i].firstname);
+        free(lists[i].lastname);
+    }
+    free(lists);
+    lists=NULL;
+    size=count=0;
+    loaded=false;
+}
+
+unsigned int cEPLists::hash(const char *Name, int Len)
+{
+    // FNV-1a
+    unsigned int h=2166136261U;
+    for (int i=0; i<Len; i++)
+    {
+        h^=(unsigned char) Name[i];
+        h*=16777619U;
+    }
+    return h;
+}
+
+struct cEPLists::eplist *cEPLists::lookup(const char *LName, int Len)
+{
+    if (!size) return NULL;
+    for (unsigned int i=hash(LName,Len) & (size-1); lists[i].lname; i=(i+1) & (size-1))
+    {
+        if ((lists[i].len==Len) && (!memcmp(lists[i].lname,LName,Len))) return &lists[i];
+    }
+    return NULL;
+}
+
+void cEPLists::add(const char *Name, int Pos, bool Xml)
+{
+    int len=strlen(Name);
+    char *lname=strdup(Name);
+    if (!lname) return;
+    for (int i=0; i<len; i++) lname[i]=tolower((unsigned char) lname[i]);
+
+    struct eplist *l=lookup(lname,len);
+    if (l)
+    {
+        // same name with different case or with another suffix
+        bool xml=Xml;
+        if ((!strcmp(l->lastname,Name)) && (!l->lastxml)) xml=false;
+        if ((!strcmp(l->firstname,Name)) && (!Xml)) l->firstxml=false;
+        char *lastname=strdup(Name);
+        if (lastname)
+        {
+            free(l->lastname);
+            l->lastname=lastname;
+            l->lastxml=xml;
+            l->last=Pos;
+        }
+        free(lname);
+        return;
+    }
+
+    if (count*2>=size)
+    {
+        int nsize=size ? size*2 : 1024;
+        struct eplist *nlists=(struct eplist *) calloc(nsize,sizeof(struct eplist));
+        if (!nlists)
+        {
+            free(lname);
+            return;
+        }
+        for (int i=0; i<size; i++)
+        {
+            if (!lists[i].lname) continue;
+            unsigned int x=hash(lists[i].lname,lists[i].len) & (nsize-1);
+            while (nlists[x].lname) x=(x+1) & (nsize-1);
+            nlists[x]=lists[i];
+        }
+        free(lists);
+        lists=nlists;
+        size=nsize;
+    }
+    unsigned int x=hash(lname,len) & (size-1);
+    while (lists[x].lname) x=(x+1) & (size-1);
+    lists[x].firstname=strdup(Name);
+    lists[x].lastname=strdup(Name);
+    if ((!lists[x].firstname) || (!lists[x].lastname))
+    {
+        free(lists[x].firstname);
+        free(lists[x].lastname);
+        free(lname);
+        return;
+    }
+    lists[x].firstxml=Xml;
+    lists[x].lastxml=Xml;
+    lists[x].lname=lname;
+    lists[x].len=len;
+    lists[x].last=Pos;
+    count++;
+}
+
+bool cEPLists::load(const char *Dir)
+{
+    clear();
+    DIR *d=opendir(Dir);
+    if (!d) return false;
+    struct dirent *dirent;
+    int pos=0;
+    while ((dirent=readdir(d)))
+    {
+        if (dirent->d_name[0]=='.') continue;
+        bool xml=false;
+        char *pt=strrchr(dirent->d_name,'.');
+        if (pt)
+        {
+            xml=(!strcmp(pt,EPXMLSUFFIX));
+            *pt=0;
+        }
+        add(dirent->d_name,pos++,xml);
+    }
+    closedir(d);
+    loaded=true;
+    return true;
+}
+
+bool cEPLists::check(const char *Dir)
+{
+    // the directory is checked for changes at most every EPLISTSCHECK seconds
+    time_t now=time(NULL);
+    bool samedir=((dir) && (!strcmp(dir,Dir)));
+    if ((samedir) && (now-lastcheck<EPLISTSCHECK)) return loaded;
+    lastcheck=now;
+
+    struct stat statbuf;
+    if (stat(Dir,&statbuf)==-1)
+    {
+        clear();
+        return false;
+    }
+    if ((samedir) && (loaded) && (statbuf.st_mtim.tv_sec==mtime) &&
+            (statbuf.st_mtim.tv_nsec==mtimensec)) return true;
+
+    if (!samedir)
+    {
+        if (dir) free(dir);
+        dir=strdup(Dir);
+        if (!dir)
+        {
+            clear();
+            return false;
+        }
+    }
+    mtime=statbuf.st_mtim.tv_sec;
+    mtimensec=statbuf.st_mtim.tv_nsec;
+    return load(Dir);
+}
+
+bool cEPLists::Find(const char *Dir, const char *Title, char **Name, const char **Suffix)
+{
+    // same result as scanning the directory for a file named like the
+    // title, or (the last one found) like the title up to a space
+    *Name=NULL;
+    if (Suffix) *Suffix=EPLISTSUFFIX;
+    if ((!Dir) || (!Title)) return false;
+    cMutexLock lock(&mutex);
+    if (!check(Dir)) return false;
+
+    int tlen=strlen(Title);
+    char *ltitle=strdup(Title);
+    if (!ltitle) return true;
+    for (int i=0; i<tlen; i++) ltitle[i]=tolower((unsigned char) ltitle[i]);
+
+    struct eplist *l=lookup(ltitle,tlen);
+    if (l)
+    {
+        *Name=strdup(l->firstname);
+        if (Suffix) *Suffix=l->firstxml ? EPXMLSUFFIX : EPLISTSUFFIX;
+    }
+    else
+    {
+        struct eplist *best=NULL;
+        for (int i=1; i<tlen; i++)
+        {
+            if (Title[i]!=' ') continue;
+            l=lookup(ltitle,i);
+            if ((l) && ((!best) || (l->last>best->last))) best=l;
+        }
+        if (best)
+        {
+            *Name=strdup(best->lastname);
+            if (Suffix) *Suffix=best->lastxml ? EPXMLSUFFIX : EPLISTSUFFIX;
+        }
+    }
+    free(ltitle);
+    return true;
+}
+
+void cEPLists::evict(cEPList *Keep)
+{
+    // drop the least recently used files until the cache fits
+    cEPList *l=cache.Last();
+    while ((l) && (cachesize>maxcachesize))
+    {
+        cEPList *prev=cache.Prev(l);
+        if (l!=Keep)
+        {
+            cachesize-=l->Memory();
+            cache.Del(l);
+        }
+        l=prev;
+    }
+}
+
+cEPList *cEPLists::get(const char *File, iconv_t cEP2ASCII)
+{
+    time_t now=time(NULL);
+    cEPList *l;
+    for (l=cache.First(); l; l=cache.Next(l))
+    {
+        if (!strcmp(l->File(),File)) break;
+    }
+    if (l)
+    {
+        if (!l->Changed(now))
+        {
+            if (l!=cache.First())
+            {
+                cache.Del(l,false);
+                cache.Ins(l);
+            }
+            return l;
+        }
+        cachesize-=l->Memory();
+        cache.Del(l);
+    }
+
+    l=new cEPList(File);
+    size_t len;
+    const void *record=findrecord(File,&len);
+    if ((!record) || (!l->Map(record,len)) || (l->Changed(now)))
+    {
+        // not in the index or changed since, parse the file
+        delete l;
+        l=new cEPList(File);
+        if (!l->Load(cEP2ASCII))
+        {
+            delete l;
+            return NULL;
+        }
+    }
+    cache.Ins(l);
+    cachesize+=l->Memory();
+    evict(l);
+    return l;
+}
+
+bool cEPLists::Load(const char *File, iconv_t cEP2ASCII, char **LinkName)
+{
+    *LinkName=NULL;
+    if (!File) return false;
+    cMutexLock lock(&cachemutex);
+    cEPList *l=get(File,cEP2ASCII);
+    if (!l) return false;
+    if (l->LinkName()) *LinkName=strdup(l->LinkName());
+    return true;
+}
+
+bool cEPLists::Match(const char *File, iconv_t cEP2ASCII, const char *ShortText, int FSeason,
+                     int FEpisode, int &Season, int &Episode, int &EpisodeOverall,
+                     char **EPShortText, bool *NotNamed, bool Fuzzy)
+{
+    if (NotNamed) *NotNamed=false;
+    if (EPShortText) *EPShortText=NULL;
+    if ((!File) || (!ShortText)) return false;
+    cMutexLock lock(&cachemutex);
+    cEPList *l=get(File,cEP2ASCII);
+    if (!l) return false;
+    if (l->Match(ShortText,FSeason,FEpisode,Season,Episode,EpisodeOverall,EPShortText,NotNamed))
+        return true;
+    if ((!Fuzzy) || (!fuzzy) || ((int) strlen(ShortText)<EPLISTSFUZZYMIN)) return false;
+
+    // only if there is neither an exact nor a prefix match
+    struct timespec start,end;
+    clock_gettime(CLOCK_MONOTONIC,&start);
+    size_t memory=l->Memory();
+    int score;
+    int n=l->Fuzzy(ShortText,fuzzy,&score);
+    cachesize+=l->Memory()-memory;
+    clock_gettime(CLOCK_MONOTONIC,&end);
+    fuzzyqueries++;
+    fuzzytime+=(end.tv_sec-start.tv_sec)*1e6+(end.tv_nsec-start.tv_nsec)/1e3;
+    if (n==-1) return false;
+    if (EPShortText && *EPShortText)
+    {
+        free(*EPShortText);
+        *EPShortText=NULL;
+    }
+    if (!l->Get(n,Season,Episode,EpisodeOverall,EPShortText)) return false;
+    fuzzyhits++;
+    tsyslog("fuzzy match for '%s' (%i%%)",ShortText,score);
+    return true;
+}
+
+void cEPLists::SetCacheSize(int MB)
+{
+    if (MB<1) MB=1;
+    cMutexLock lock(&cachemutex);
+    maxcachesize=(size_t) MB*1024*1024;
+    evict(NULL);
+}
+
+void cEPLists::dropmapped()
+{
+    // lists which use the index must go before it is unmapped
+    cEPList *l=cache.First();
+    while (l)
+    {
+        cEPList *next=cache.Next(l);
+        if (l->Mapped())
+        {
+            cachesize-=l->Memory();
+            cache.Del(l);
+        }
+        l=next;
+    }
+}
+
+void cEPLists::unmapindex()
+{
+    if (index) munmap(index,indexsize);
+    index=NULL;
+    indexsize=0;
+    offsets=NULL;
+    indexcount=0;
+}
+
+bool cEPLists::mapindex()
+{
+    unmapindex();
+    if ((!indexfile) || (!indexdir) || (!indexcodeset)) return false;
+    int fd=open(indexfile,O_RDONLY);
+    if (fd==-1) return false;
+    struct stat statbuf;
+    if ((fstat(fd,&statbuf)==-1) || ((size_t) statbuf.st_size<sizeof(struct indexheader)))
+    {
+        close(fd);
+        return false;
+    }
+    void *map=mmap(NULL,statbuf.st_size,PROT_READ,MAP_SHARED,fd,0);
+    close(fd);
+    if (map==MAP_FAILED) return false;
+    index=(unsigned char *) map;
+    indexsize=statbuf.st_size;
+
+    const struct indexheader *h=(const struct indexheader *) index;
+    size_t pos=sizeof(struct indexheader)+h->dirlen+h->codesetlen;
+    if ((memcmp(h->magic,EPINDEXMAGIC,sizeof(h->magic))) || (h->version!=EPINDEXVERSION) ||
+            (h->byteorder!=0x01020304) || (pos>indexsize) ||
+            (EPALIGN(pos)+(size_t) h->count*sizeof(uint64_t)>indexsize))
+    {
+        isyslog("ignoring invalid episode index %s",indexfile);
+        unmapindex();
+        return false;
+    }
+    const char *idir=(const char *) index+sizeof(struct indexheader);
+    const char *icodeset=idir+h->dirlen;
+    if ((h->dirlen!=strlen(indexdir)+1) || (memcmp(idir,indexdir,h->dirlen)) ||
+            (h->codesetlen!=strlen(indexcodeset)+1) || (memcmp(icodeset,indexcodeset,h->codesetlen)))
+    {
+        // made for another directory or codeset
+        unmapindex();
+        return false;
+    }
+    offsets=(const uint64_t *)(index+EPALIGN(pos));
+    indexcount=h->count;
+    for (uint32_t i=0; i<indexcount; i++)
+    {
+        if ((offsets[i]>=indexsize) || (offsets[i] & 7))
+        {
+            isyslog("ignoring invalid episode index %s",indexfile);
+            unmapindex();
+            return false;
+        }
+    }
+    return true;
+}
+
+const void *cEPLists::findrecord(const char *File, size_t *Len)
+{
+    if (!indexchecked)
+    {
+        indexchecked=true;
+        mapindex();
+    }
+    if (!index) return NULL;
+    size_t dlen=strlen(indexdir);
+    if ((strncmp(File,indexdir,dlen)) || (File[dlen]!='/')) return NULL;
+    const char *name=File+dlen+1;
+
+    // the records are sorted by name
+    int lo=0,hi=(int) indexcount-1;
+    while (lo<=hi)
+    {
+        int mid=(lo+hi)/2;
+        const void *record=index+offsets[mid];
+        size_t len=indexsize-offsets[mid];
+        const char *rname=cEPList::RecordName(record,len);
+        if (!rname) return NULL;
+        int c=strcmp(name,rname);
+        if (!c)
+        {
+            *Len=len;
+            return record;
+        }
+        if (c<0)
+        {
+            hi=mid-1;
+        }
+        else
+        {
+            lo=mid+1;
+        }
+    }
+    return NULL;
+}
+
+void cEPLists::SetIndex(const char *File, const char *Dir, const char *Codeset)
+{
+    cMutexLock updatelock(&updatemutex);
+    cMutexLock lock(&cachemutex);
+    dropmapped();
+    unmapindex();
+    free(indexfile);
+    free(indexdir);
+    free(indexcodeset);
+    indexfile=File ? strdup(File) : NULL;
+    indexdir=Dir ? strdup(Dir) : NULL;
+    indexcodeset=Codeset ? strdup(Codeset) : NULL;
+    indexchecked=false;
+}
+
+bool cEPLists::UpdateIndex(bool Force)
+{
+    // writes a new index, only files which changed since the last
+    // update are parsed again
+    cMutexLock updatelock(&updatemutex);
+    {
+        cMutexLock lock(&cachemutex);
+        if ((!indexfile) || (!indexdir) || (!indexcodeset)) return false;
+        if (!indexchecked)
+        {
+            indexchecked=true;
+            mapindex();
+        }
+    }
+    // the current index is only replaced below, while holding updatemutex
+
+    iconv_t cep2ascii=iconv_open("ASCII//TRANSLIT",indexcodeset);
+    if (cep2ascii==(iconv_t) -1)
+    {
+        esyslog("cannot convert from %s for episode index",indexcodeset);
+        return false;
+    }
+
+    cStringList names;
+    DIR *d=opendir(indexdir);
+    if (!d)
+    {
+        iconv_close(cep2ascii);
+        return false;
+    }
+    struct dirent *dirent;
+    while ((dirent=readdir(d)))
+    {
+        if (dirent->d_name[0]=='.') continue;
+        const char *pt=strrchr(dirent->d_name,'.');
+        if ((!pt) || (pt==dirent->d_name)) continue;
+        if ((strcmp(pt,EPLISTSUFFIX)) && (strcmp(pt,EPXMLSUFFIX))) continue;
+        names.Append(strdup(dirent->d_name));
+    }
+    closedir(d);
+    names.Sort();
+
+    char *tmpfile=NULL;
+    if (asprintf(&tmpfile,"%s.new",indexfile)==-1)
+    {
+        iconv_close(cep2ascii);
+        return false;
+    }
+    FILE *f=fopen(tmpfile,"w");
+    if (!f)
+    {
+        esyslog("cannot create %s",tmpfile);
+        free(tmpfile);
+        iconv_close(cep2ascii);
+        return false;
+    }
+
+    struct indexheader h;
+    memset(&h,0,sizeof(h));
+    memcpy(h.magic,EPINDEXMAGIC,sizeof(h.magic));
+    h.version=EPINDEXVERSION;
+    h.byteorder=0x01020304;
+    h.dirlen=strlen(indexdir)+1;
+    h.codesetlen=strlen(indexcodeset)+1;
+    size_t head=sizeof(h)+h.dirlen+h.codesetlen;
+    uint64_t *noffsets=(uint64_t *) calloc(names.Size()+1,sizeof(uint64_t));
+    bool ok=(noffsets!=NULL);
+    if (ok) ok=(fseek(f,EPALIGN(head)+names.Size()*sizeof(uint64_t),SEEK_SET)==0);
+
+    time_t now=time(NULL);
+    int parsed=0;
+    for (int i=0; (ok) && (i<names.Size()); i++)
+    {
+        char *file=NULL;
+        if (asprintf(&file,"%s/%s",indexdir,names[i])==-1) continue;
+        cEPList *l=new cEPList(file);
+        size_t len;
+        const void *record=Force ? NULL : findrecord(file,&len);
+        if ((!record) || (!l->Map(record,len)) || (l->Changed(now)))
+        {
+            delete l;
+            l=new cEPList(file);
+            if (!l->Load(cep2ascii))
+            {
+                delete l;
+                free(file);
+                continue;
+            }
+            parsed++;
+        }
+        noffsets[h.count]=ftell(f);
+        ok=l->Write(f,names[i]);
+        if (ok) h.count++;
+        delete l;
+        free(file);
+    }
+    iconv_close(cep2ascii);
+
+    if (ok) ok=(fseek(f,0,SEEK_SET)==0);
+    if (ok) ok=(fwrite(&h,sizeof(h),1,f)==1);
+    if (ok) ok=(fwrite(indexdir,h.dirlen,1,f)==1);
+    if (ok) ok=(fwrite(indexcodeset,h.codesetlen,1,f)==1);
+    static const char zero[8]= { 0 };
+    if ((ok) && (EPALIGN(head)>head)) ok=(fwrite(zero,EPALIGN(head)-head,1,f)==1);
+    if ((ok) && (h.count)) ok=(fwrite(noffsets,sizeof(uint64_t),h.count,f)==h.count);
+    if (fclose(f)) ok=false;
+    free(noffsets);
+    if ((!ok) || (rename(tmpfile,indexfile)==-1))
+    {
+        esyslog("failed to write episode index %s",indexfile);
+        unlink(tmpfile);
+        free(tmpfile);
+        return false;
+    }
+    free(tmpfile);
+
+    cMutexLock lock(&cachemutex);
+    dropmapped();
+    mapindex();
+    isyslog("episode index updated (%i files, %i parsed)",h.count,parsed);
+    return true;
+}
+
+void cEPLists::SetFuzzy(int Percent)
+{
+    cMutexLock lock(&cachemutex);
+    fuzzy=(Percent>100) ? 100 : Percent;
+    if (fuzzy<0) fuzzy=0;
+}
+
+bool cEPLists::FuzzyStatistics(int &Queries, int &Hits, double &Microseconds)
+{
+    // returns and resets the statistics
+    cMutexLock lock(&cachemutex);
+    Queries=fuzzyqueries;
+    Hits=fuzzyhits;
+    Microseconds=fuzzyqueries ? fuzzytime/fuzzyqueries : 0;
+    fuzzyqueries=fuzzyhits=0;
+    fuzzytime=0;
+    return (Queries>0);
+}
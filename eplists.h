@@ -0,0 +1,213 @@
+/*
+ * eplists.h: A plugin for the Video Disk Recorder
+ *
+ * See the README file for copyright information and how to reach the author.
+ *
+ */
+
+#ifndef _EPLISTS_H
+#define _EPLISTS_H
+
+#include <vdr/thread.h>
+#include <vdr/tools.h>
+#include <iconv.h>
+#include <time.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <sys/types.h>
+
+// seconds between checks for changes of the eplists directory and files
+#define EPLISTSCHECK 10
+// default memory limit for cached .episodes files in MB
+#define EPLISTSCACHE 8
+// default similarity in percent for fuzzy matches of shorttexts
+#define EPLISTSFUZZY 70
+// shorter shorttexts are never matched fuzzy
+#define EPLISTSFUZZYMIN 5
+
+// episode files, VDRSeriesTimer lists are preferred over TheTVDB xml
+#define EPLISTSUFFIX ".episodes"
+#define EPXMLSUFFIX ".xml"
+
+// persistent index of all parsed .episodes files
+#define EPINDEXFILE "eplists.idx"
+#define EPINDEXMAGIC "XEPINDEX"
+#define EPINDEXVERSION 1
+
+class cEPList : public cListObject
+{
+private:
+    struct episode
+    {
+        int season;
+        int episode;
+        int overall;
+        int text;        // offset of the shorttext as in the file
+        int key;         // offset of the normalized, lowercase shorttext
+        int len;
+    };
+    struct record
+    {
+        // layout of a cEPList in the index, followed by the name, the
+        // linkname, episodes, keys, seasonepisodes and strings
+        uint32_t reclen;
+        uint32_t namelen;
+        uint32_t linknamelen;
+        int32_t count;
+        int32_t size;
+        int32_t lastseason,lastepisode,lastoverall,lastset;
+        uint32_t stringsize;
+        uint64_t dev;
+        uint64_t ino;
+        int64_t fsize;
+        int64_t mtime;
+        int64_t mtimensec;
+    };
+    char *file;
+    char *linkname;
+    dev_t dev;
+    ino_t ino;
+    off_t fsize;
+    time_t mtime;
+    long mtimensec;
+    time_t lastcheck;
+    struct episode *episodes;
+    int count;
+    int *keys;           // first episode for each key
+    int *seasonepisodes; // first episode for each season/episode
+    int size;
+    char *strings;
+    int stringsize;
+    int stringalloc;
+    bool mapped;         // all data lives in the index
+    size_t memory;
+    // values of the last line, even if it couldn't be parsed completely
+    int lastseason,lastepisode,lastoverall;
+    int lastset;
+    // trigrams of all keys, built on the first fuzzy search
+    uint32_t *tgcodes;
+    int *tgstart;
+    int *tgentries;
+    int *tgsizes;
+    int tgcount;
+    bool tgbuilt;
+    static int trigrams(const char *Key, int Len, uint32_t *Codes);
+    bool buildtrigrams();
+    static unsigned int hash(const char *Key, int Len);
+    static unsigned int hash(int Season, int Episode);
+    int findkey(const char *Key, int Len, unsigned int Hash);
+    int findseasonepisode(int Season, int Episode);
+    int addstring(const char *String);
+    bool add(int Season, int Episode, int Overall, const char *Text, const char *Key);
+    bool addepisode(iconv_t Conv, int Season, int Episode, int Overall, const char *Text);
+    bool loadxml(int Fd);
+    bool index();
+public:
+    cEPList(const char *File);
+    ~cEPList();
+    bool Load(iconv_t cEP2ASCII);
+    bool Map(const void *Record, size_t Len);
+    bool Write(FILE *File, const char *Name);
+    static const char *RecordName(const void *Record, size_t Len);
+    bool Changed(time_t Now);
+    bool Match(const char *ShortText, int FSeason, int FEpisode, int &Season, int &Episode,
+               int &EpisodeOverall, char **EPShortText, bool *NotNamed);
+    int Fuzzy(const char *ShortText, int Threshold, int *Score);
+    bool Get(int Number, int &Season, int &Episode, int &EpisodeOverall, char **EPShortText);
+    const char *File()
+    {
+        return file;
+    }
+    const char *LinkName()
+    {
+        return linkname;
+    }
+    size_t Memory()
+    {
+        return memory;
+    }
+    bool Mapped()
+    {
+        return mapped;
+    }
+};
+
+class cEPLists
+{
+private:
+    struct eplist
+    {
+        char *lname;     // lowercase filename without extension, the key
+        int len;
+        char *firstname; // first and last filename with this key
+        char *lastname;
+        bool firstxml;   // TheTVDB xml instead of an episodes file
+        bool lastxml;
+        int last;        // position of lastname in the directory
+    };
+    cMutex mutex;
+    char *dir;
+    time_t mtime;
+    long mtimensec;
+    time_t lastcheck;
+    bool loaded;
+    struct eplist *lists;
+    int size;
+    int count;
+    static unsigned int hash(const char *Name, int Len);
+    struct eplist *lookup(const char *LName, int Len);
+    void add(const char *Name, int Pos, bool Xml);
+    void clear();
+    bool load(const char *Dir);
+    bool check(const char *Dir);
+    cMutex cachemutex;
+    cList<cEPList> cache;
+    size_t cachesize;
+    size_t maxcachesize;
+    int fuzzy;
+    int fuzzyqueries;
+    int fuzzyhits;
+    double fuzzytime;
+    void evict(cEPList *Keep);
+    cEPList *get(const char *File, iconv_t cEP2ASCII);
+    char *indexfile;
+    char *indexdir;
+    char *indexcodeset;
+    bool indexchecked;
+    unsigned char *index;
+    size_t indexsize;
+    const uint64_t *offsets;
+    uint32_t indexcount;
+    struct indexheader
+    {
+        char magic[8];
+        uint32_t version;
+        uint32_t byteorder;
+        uint32_t count;
+        uint32_t dirlen;
+        uint32_t codesetlen;
+        uint32_t reserved;
+    };
+    bool mapindex();
+    void unmapindex();
+    void dropmapped();
+    cMutex updatemutex;
+    const void *findrecord(const char *File, size_t *Len);
+public:
+    cEPLists();
+    ~cEPLists();
+    bool Find(const char *Dir, const char *Title, char **Name, const char **Suffix=NULL);
+    bool Load(const char *File, iconv_t cEP2ASCII, char **LinkName);
+    bool Match(const char *File, iconv_t cEP2ASCII, const char *ShortText, int FSeason,
+               int FEpisode, int &Season, int &Episode, int &EpisodeOverall,
+               char **EPShortText, bool *NotNamed, bool Fuzzy=false);
+    void SetCacheSize(int MB);
+    void SetFuzzy(int Percent);
+    bool FuzzyStatistics(int &Queries, int &Hits, double &Microseconds);
+    void SetIndex(const char *File, const char *Dir, const char *Codeset);
+    bool UpdateIndex(bool Force);
+};
+
+extern cEPLists EPLists;
+
+#endif
@@ -7,8 +7,6 @@
 
 #include <stdlib.h>
 #include <stdio.h>
-#include <vector>
-#include <regex>
 #include <vdr/tools.h>
 #include "event.h"
 
@@ -44,6 +42,64 @@ const char* cXMLTVStringList::toString()
 
 // -------------------------------------------------------------
 
+cXMLTVValues::cXMLTVValues()
+{
+    memset(values,0,sizeof(values));
+}
+
+cXMLTVValues::~cXMLTVValues()
+{
+    Clear();
+}
+
+void cXMLTVValues::Clear()
+{
+    for (int i=1; i<=XMLTVPARAMS; i++) free(values[i].text);
+    memset(values,0,sizeof(values));
+}
+
+void cXMLTVValues::SetText(int Param, const char *Text)
+{
+    if ((Param<1) || (Param>XMLTVPARAMS)) return;
+    free(values[Param].text);
+    values[Param].text=Text ? strdup(Text) : NULL;
+    values[Param].type=values[Param].text ? SQLITE_TEXT : SQLITE_NULL;
+}
+
+void cXMLTVValues::SetNumber(int Param, sqlite3_int64 Number)
+{
+    if ((Param<1) || (Param>XMLTVPARAMS)) return;
+    free(values[Param].text);
+    values[Param].text=NULL;
+    values[Param].number=Number;
+    values[Param].type=SQLITE_INTEGER;
+}
+
+int cXMLTVValues::Bind(sqlite3_stmt *Stmt)
+{
+    // the texts must live until the statement is reset
+    for (int i=1; i<=XMLTVPARAMS; i++)
+    {
+        int ret;
+        switch (values[i].type)
+        {
+        case SQLITE_TEXT:
+            ret=sqlite3_bind_text(Stmt,i,values[i].text,-1,SQLITE_STATIC);
+            break;
+        case SQLITE_INTEGER:
+            ret=sqlite3_bind_int64(Stmt,i,values[i].number);
+            break;
+        default:
+            ret=sqlite3_bind_null(Stmt,i);
+            break;
+        }
+        if (ret!=SQLITE_OK) return ret;
+    }
+    return SQLITE_OK;
+}
+
+// -------------------------------------------------------------
+
 char* cXMLTVEvent::removechar(char* s, char what)
 {
     if (!s) return NULL;
@@ -62,7 +118,6 @@ void cXMLTVEvent::SetSource(const char *Source)
     source=strcpyrealloc(source, Source);
     if (source)
     {
-        source=removechar(source,'^');
         source=compactspace(source);
     }
 }
@@ -72,7 +127,6 @@ void cXMLTVEvent::SetChannelID(const char *ChannelID)
     channelid=strcpyrealloc(channelid, ChannelID);
     if (channelid)
     {
-        channelid=removechar(channelid,'^');
         channelid=compactspace(channelid);
     }
 }
@@ -82,7 +136,6 @@ void cXMLTVEvent::SetTitle(const char *Title)
     title=strcpyrealloc(title, Title);
     if (title)
     {
-        title=removechar(title,'^');
         title=removechar(title,'\n');
         title=removechar(title,'\r');
         title=compactspace(title);
@@ -94,7 +147,6 @@ void cXMLTVEvent::SetAltTitle(const char *AltTitle)
     alttitle=strcpyrealloc(alttitle, AltTitle);
     if (alttitle)
     {
-        alttitle=removechar(alttitle,'^');
         alttitle=removechar(alttitle,'\n');
         alttitle=removechar(alttitle,'\r');
         alttitle=compactspace(alttitle);
@@ -106,7 +158,6 @@ void cXMLTVEvent::SetOrigTitle(const char *OrigTitle)
     origtitle=strcpyrealloc(origtitle, OrigTitle);
     if (origtitle)
     {
-        origtitle=removechar(origtitle,'^');
         origtitle=compactspace(origtitle);
     }
 }
@@ -116,7 +167,6 @@ void cXMLTVEvent::SetShortText(const char *ShortText)
     shorttext=strcpyrealloc(shorttext,ShortText);
     if (shorttext)
     {
-        shorttext=removechar(shorttext,'^');
         shorttext=removechar(shorttext,'\n');
         shorttext=removechar(shorttext,'\r');
         shorttext=compactspace(shorttext);
@@ -133,7 +183,6 @@ void cXMLTVEvent::AddDescription(const char *Description)
     {
         description=strcatrealloc(description,"\n");
         description=strcatrealloc(description,Description);
-        description=removechar(description,'^');
         description=compactspace(description);
     }
 }
@@ -143,7 +192,6 @@ void cXMLTVEvent::SetDescription(const char *Description)
     description=strcpyrealloc(description, Description);
     if (description)
     {
-        description=removechar(description,'^');
         description=compactspace(description);
     }
 }
@@ -153,7 +201,6 @@ void cXMLTVEvent::SetEITDescription(const char *EITDescription)
     eitdescription=strcpyrealloc(eitdescription, EITDescription);
     if (eitdescription)
     {
-        eitdescription=removechar(eitdescription,'^');
         eitdescription=compactspace(eitdescription);
     }
 }
@@ -163,7 +210,6 @@ void cXMLTVEvent::SetCountry(const char *Country)
     country=strcpyrealloc(country, Country);
     if (country)
     {
-        country=removechar(country,'^');
         country=compactspace(country);
     }
 }
@@ -173,7 +219,6 @@ void cXMLTVEvent::SetAudio(const char *Audio)
     audio=strcpyrealloc(audio, Audio);
     if (audio)
     {
-        audio=removechar(audio,'^');
         audio=compactspace(audio);
     }
 }
@@ -191,7 +236,6 @@ void cXMLTVEvent::SetCredits(const char *Credits)
         char *val=strdup(tok);
         if (val)
         {
-            val=removechar(val,'^');
             val=compactspace(val);
             credits.Append(val);
         }
@@ -214,7 +258,6 @@ void cXMLTVEvent::SetCategory(const char *Category)
         char *val=strdup(tok);
         if (val)
         {
-            val=removechar(val,'^');
             val=compactspace(val);
             category.Append(val);
         }
@@ -237,7 +280,6 @@ void cXMLTVEvent::SetReview(const char *Review)
         char *val=strdup(tok);
         if (val)
         {
-            val=removechar(val,'^');
             val=compactspace(val);
             review.Append(val);
         }
@@ -259,7 +301,6 @@ void cXMLTVEvent::SetRating(const char *Rating)
         char *val=strdup(tok);
         if (val)
         {
-            val=removechar(val,'^');
             val=compactspace(val);
             rating.Append(val);
             char *rval=strchr(tok,'|');
@@ -289,7 +330,6 @@ void cXMLTVEvent::SetVideo(const char *Video)
         char *val=strdup(tok);
         if (val)
         {
-            val=removechar(val,'^');
             val=compactspace(val);
             video.Append(val);
         }
@@ -311,7 +351,6 @@ void cXMLTVEvent::SetPics(const char* Pics)
         char *val=strdup(tok);
         if (val)
         {
-            val=removechar(val,'^');
             val=compactspace(val);
             pics.Append(val);
         }
@@ -333,7 +372,6 @@ void cXMLTVEvent::SetStarRating(const char *StarRating)
         char *val=strdup(tok);
         if (val)
         {
-            val=removechar(val,'^');
             val=compactspace(val);
             starrating.Append(val);
         }
@@ -348,7 +386,6 @@ void cXMLTVEvent::AddReview(const char *Review)
     char *val=strdup(Review);
     if (val)
     {
-        val=removechar(val,'^');
         val=compactspace(val);
         review.Append(val);
     }
@@ -359,7 +396,6 @@ void cXMLTVEvent::AddPics(const char* Pic)
     char *val=strdup(Pic);
     if (val)
     {
-        val=removechar(val,'^');
         val=compactspace(val);
         pics.Append(val);
     }
@@ -369,7 +405,6 @@ void cXMLTVEvent::AddVideo(const char *VType, const char *VContent)
 {
     char *value=NULL;
     if (asprintf(&value,"%s|%s",VType,VContent)==-1) return;
-    value=removechar(value,'^');
     value=compactspace(value);
     video.Append(value);
 }
@@ -380,7 +415,6 @@ void cXMLTVEvent::AddRating(const char *System, const char *Rating)
     if (asprintf(&value,"%s|%s",System,Rating)==-1) return;
     int r=atoi(Rating);
     if ((r>0 && r<=18) && (r>parentalRating)) parentalRating=r;
-    value=removechar(value,'^');
     value=compactspace(value);
     rating.Append(value);
     rating.Sort();
@@ -397,7 +431,6 @@ void cXMLTVEvent::AddStarRating(const char *System, const char *Rating)
     {
         if (asprintf(&value,"*|%s",Rating)==-1) return;
     }
-    value=removechar(value,'^');
     value=compactspace(value);
     starrating.Append(value);
 }
@@ -407,7 +440,6 @@ void cXMLTVEvent::AddCategory(const char *Category)
     char *val=strdup(Category);
     if (val)
     {
-        val=removechar(val,'^');
         val=compactspace(val);
         category.Append(val);
         category.Sort();
@@ -425,7 +457,6 @@ void cXMLTVEvent::AddCredits(const char *CreditType, const char *Credit, const c
     {
         if (asprintf(&value,"%s|%s",CreditType,Credit)==-1) return;
     }
-    value=removechar(value,'^');
     value=compactspace(value);
     credits.Append(value);
     credits.Sort();
@@ -451,98 +482,160 @@ void cXMLTVEvent::CreateEventID(time_t StartTime)
     weakid=true;
 }
 
-void cXMLTVEvent::GetSQL(const char *Source, int SrcIdx, const char *ChannelID, char **Insert, char **Update)
-{
-    if (sql_insert)
-    {
-        free(sql_insert);
-        sql_insert=NULL;
-    }
-    if (sql_update)
-    {
-        free(sql_update);
-        sql_update=NULL;
-    }
-
-    if (!Insert) return;
-    if (!Update) return;
-
-    *Insert=NULL;
-    *Update=NULL;
-
-    const char *cr=credits.toString();
-    const char *ca=category.toString();
-    const char *re=review.toString();
-    const char *ra=rating.toString();
-    const char *sr=starrating.toString();
-    const char *vi=video.toString();
-    const char *pi=pics.toString();
-
-    if (!eventid) return;
-
-    if (asprintf(&sql_insert,
-                 "INSERT OR FAIL INTO epg (src,channelid,eventid,starttime,duration,"\
-                 "title,alttitle,origtitle,shorttext,description,country,year,credits,category,"\
-                 "review,rating,starrating,video,audio,season,episode,episodeoverall,pics,srcidx) "\
-                 "VALUES (^%s^,^%s^,%u,%li,%i,"\
-                 "^%s^,^%s^,^%s^,^%s^,^%s^,^%s^,%i,^%s^,^%s^,"\
-                 "^%s^,^%s^,^%s^,^%s^,^%s^,%i,%i,%i,^%s^,%i);"
-                 ,
-                 Source,ChannelID,eventid,starttime,duration,title,
-                 alttitle ? alttitle : "NULL",
-                 origtitle ? origtitle : "NULL",
-                 shorttext ? shorttext : "NULL",
-                 description ? description : "NULL",
-                 country ? country : "NULL",
-                 year,
-                 cr,ca,re,ra,sr,vi,
-                 audio ? audio : "NULL",
-                 season, episode, episodeoverall, pi, SrcIdx
-                )==-1)
-    {
-        sql_insert=NULL;
-        return;
-    }
-
-    if (asprintf(&sql_update,
-                 "UPDATE epg SET duration=%i,starttime=%li,title=^%s^,alttitle=^%s^,origtitle=^%s^,"\
-                 "shorttext=^%s^,description=^%s^,country=^%s^,year=%i,credits=^%s^,category=^%s^,"\
-                 "review=^%s^,rating=^%s^,starrating=^%s^,video=^%s^,audio=^%s^,season=%i,episode=%i, "\
-                 "episodeoverall=%i,pics=^%s^,srcidx=%i " \
-                 " where src=^%s^ and channelid=^%s^ and eventid=%u"
-                 ,
-                 duration,starttime,title,
-                 alttitle ? alttitle : "NULL",
-                 origtitle ? origtitle : "NULL",
-                 shorttext ? shorttext : "NULL",
-                 description ? description : "NULL",
-                 country ? country : "NULL",
-                 year,
-                 cr,ca,re,ra,sr,vi,
-                 audio ? audio : "NULL",
-                 season, episode, episodeoverall, pi, SrcIdx,
-                 Source,ChannelID,eventid
-                )==-1)
-    {
-        sql_update=NULL;
-        return;
-    }
-
-    std::string si=sql_insert;
-    si = std::regex_replace(si, std::regex("'"), "''");
-    si = std::regex_replace(si, std::regex("\\^"), "'");
-    si = std::regex_replace(si, std::regex("'NULL'"), "NULL");
-    sql_insert=(char *) realloc(sql_insert,si.size()+1);
-    strcpy(sql_insert,si.c_str());
-    *Insert=sql_insert;
-
-    std::string su=sql_update;
-    su = std::regex_replace(su, std::regex("'"), "''");
-    su = std::regex_replace(su, std::regex("\\^"), "'");
-    su = std::regex_replace(su, std::regex("'NULL'"), "NULL");
-    sql_update=(char *) realloc(sql_update,su.size()+1);
-    strcpy(sql_update,su.c_str());
-    *Update=sql_update;
+static uint64_t fnv1a(uint64_t Hash, const char *String)
+{
+    // NULL and empty strings get different hashes
+    if (!String) return (Hash^0xff)*1099511628211ULL;
+    do
+    {
+        Hash^=(unsigned char) *String;
+        Hash*=1099511628211ULL;
+    }
+    while (*String++);
+    return Hash;
+}
+
+static uint64_t fnv1a(uint64_t Hash, long Value)
+{
+    char buf[32];
+    snprintf(buf,sizeof(buf),"%li",Value);
+    return fnv1a(Hash,buf);
+}
+
+uint64_t cXMLTVEvent::Hash(int SrcIdx)
+{
+    // fingerprint of all columns written by GetSQL, except the key
+    uint64_t h=14695981039346656037ULL;
+    h=fnv1a(h,(long) starttime);
+    h=fnv1a(h,(long) duration);
+    h=fnv1a(h,title);
+    h=fnv1a(h,alttitle);
+    h=fnv1a(h,origtitle);
+    h=fnv1a(h,shorttext);
+    h=fnv1a(h,description);
+    h=fnv1a(h,country);
+    h=fnv1a(h,(long) year);
+    h=fnv1a(h,credits.toString());
+    h=fnv1a(h,category.toString());
+    h=fnv1a(h,review.toString());
+    h=fnv1a(h,rating.toString());
+    h=fnv1a(h,starrating.toString());
+    h=fnv1a(h,video.toString());
+    h=fnv1a(h,audio);
+    h=fnv1a(h,(long) season);
+    h=fnv1a(h,(long) episode);
+    h=fnv1a(h,(long) episodeoverall);
+    h=fnv1a(h,pics.toString());
+    h=fnv1a(h,(long) SrcIdx);
+    return h;
+}
+
+static sqlite3_int64 dbkey(sqlite3 *Db, const char *Insert, const char *Select, const char *Name)
+{
+    // adds the name to a lookup table if needed and returns its key
+    if ((!Db) || (!Name)) return -1;
+    sqlite3_int64 key=-1;
+    sqlite3_stmt *stmt;
+    if (sqlite3_prepare_v2(Db,Select,-1,&stmt,NULL)!=SQLITE_OK) return -1;
+    sqlite3_bind_text(stmt,1,Name,-1,SQLITE_STATIC);
+    int ret=sqlite3_step(stmt);
+    if (ret==SQLITE_ROW) key=sqlite3_column_int64(stmt,0);
+    sqlite3_finalize(stmt);
+    if (ret!=SQLITE_DONE) return key;
+
+    if (sqlite3_prepare_v2(Db,Insert,-1,&stmt,NULL)!=SQLITE_OK) return -1;
+    sqlite3_bind_text(stmt,1,Name,-1,SQLITE_STATIC);
+    if (sqlite3_step(stmt)==SQLITE_DONE) key=sqlite3_last_insert_rowid(Db);
+    sqlite3_finalize(stmt);
+    return key;
+}
+
+sqlite3_int64 cXMLTVEvent::SourceKey(sqlite3 *Db, const char *Source)
+{
+    return dbkey(Db,"INSERT INTO sources (src) VALUES (?1)",
+                 "SELECT srcid FROM sources WHERE src=?1",Source);
+}
+
+sqlite3_int64 cXMLTVEvent::ChannelKey(sqlite3 *Db, const char *ChannelID)
+{
+    return dbkey(Db,"INSERT INTO channels (channelid) VALUES (?1)",
+                 "SELECT chid FROM channels WHERE channelid=?1",ChannelID);
+}
+
+const char *cXMLTVEvent::InsertSQL()
+{
+    return "INSERT OR FAIL INTO epg (srcid,chid,eventid,starttime,duration,"\
+           "title,alttitle,origtitle,shorttext,description,country,year,credits,category,"\
+           "review,rating,starrating,video,audio,season,episode,episodeoverall,pics,srcidx,hash,"\
+           "epstamp,endtime) "\
+           "VALUES (?1,?2,?3,?4,?5,?6,?7,?8,?9,?10,?11,?12,?13,?14,?15,?16,?17,?18,?19,?20,"\
+           "?21,?22,?23,?24,?25,?26,?4+?5)";
+}
+
+const char *cXMLTVEvent::UpdateSQL()
+{
+    return "UPDATE epg SET duration=?5,starttime=?4,title=?6,alttitle=?7,origtitle=?8,"\
+           "shorttext=?9,description=?10,country=?11,year=?12,credits=?13,category=?14,"\
+           "review=?15,rating=?16,starrating=?17,video=?18,audio=?19,season=?20,episode=?21,"\
+           "episodeoverall=?22,pics=?23,srcidx=?24,hash=?25,epstamp=?26,endtime=?4+?5 "\
+           "WHERE srcid=?1 AND chid=?2 AND eventid=?3";
+}
+
+const char *cXMLTVEvent::UpsertSQL()
+{
+    // same parameters as InsertSQL() and UpdateSQL()
+    return "INSERT INTO epg (srcid,chid,eventid,starttime,duration,"\
+           "title,alttitle,origtitle,shorttext,description,country,year,credits,category,"\
+           "review,rating,starrating,video,audio,season,episode,episodeoverall,pics,srcidx,hash,"\
+           "epstamp,endtime) "\
+           "VALUES (?1,?2,?3,?4,?5,?6,?7,?8,?9,?10,?11,?12,?13,?14,?15,?16,?17,?18,?19,?20,"\
+           "?21,?22,?23,?24,?25,?26,?4+?5) "\
+           "ON CONFLICT(eventid,srcid,chid) DO UPDATE SET duration=?5,starttime=?4,title=?6,"\
+           "alttitle=?7,origtitle=?8,shorttext=?9,description=?10,country=?11,year=?12,"\
+           "credits=?13,category=?14,review=?15,rating=?16,starrating=?17,video=?18,audio=?19,"\
+           "season=?20,episode=?21,episodeoverall=?22,pics=?23,srcidx=?24,hash=?25,epstamp=?26,"\
+           "endtime=?4+?5";
+}
+
+bool cXMLTVEvent::HasUpsert()
+{
+    // INSERT ... ON CONFLICT DO UPDATE is available since sqlite 3.24.0
+    return (sqlite3_libversion_number()>=3024000);
+}
+
+void cXMLTVEvent::GetSQLValues(sqlite3_int64 SrcID, int SrcIdx, cXMLTVValues *Values)
+{
+    // all columns except the channel key, which is set for each channel
+    if (!Values) return;
+
+    // before toString(), Hash() rebuilds the string buffers
+    Values->SetNumber(XMLTVPARAM_HASH,(sqlite3_int64) Hash(SrcIdx));
+    // season and episode are from the eplists as of now
+    Values->SetNumber(XMLTVPARAM_EPSTAMP,(sqlite3_int64) time(NULL));
+
+    Values->SetNumber(XMLTVPARAM_SRCID,SrcID);
+    Values->SetNumber(XMLTVPARAM_EVENTID,eventid);
+    Values->SetNumber(XMLTVPARAM_STARTTIME,starttime);
+    Values->SetNumber(XMLTVPARAM_DURATION,duration);
+    Values->SetText(XMLTVPARAM_TITLE,title);
+    Values->SetText(XMLTVPARAM_ALTTITLE,alttitle);
+    Values->SetText(XMLTVPARAM_ORIGTITLE,origtitle);
+    Values->SetText(XMLTVPARAM_SHORTTEXT,shorttext);
+    Values->SetText(XMLTVPARAM_DESCRIPTION,description);
+    Values->SetText(XMLTVPARAM_COUNTRY,country);
+    Values->SetNumber(XMLTVPARAM_YEAR,year);
+    Values->SetText(XMLTVPARAM_CREDITS,credits.Size() ? credits.toString() : NULL);
+    Values->SetText(XMLTVPARAM_CATEGORY,category.Size() ? category.toString() : NULL);
+    Values->SetText(XMLTVPARAM_REVIEW,review.Size() ? review.toString() : NULL);
+    Values->SetText(XMLTVPARAM_RATING,rating.Size() ? rating.toString() : NULL);
+    Values->SetText(XMLTVPARAM_STARRATING,starrating.Size() ? starrating.toString() : NULL);
+    Values->SetText(XMLTVPARAM_VIDEO,video.Size() ? video.toString() : NULL);
+    Values->SetText(XMLTVPARAM_AUDIO,audio);
+    Values->SetNumber(XMLTVPARAM_SEASON,season);
+    Values->SetNumber(XMLTVPARAM_EPISODE,episode);
+    Values->SetNumber(XMLTVPARAM_EPISODEOVERALL,episodeoverall);
+    Values->SetText(XMLTVPARAM_PICS,pics.Size() ? pics.toString() : NULL);
+    Values->SetNumber(XMLTVPARAM_SRCIDX,SrcIdx);
 }
 
 void cXMLTVEvent::Clear()
@@ -552,16 +645,6 @@ void cXMLTVEvent::Clear()
         free(source);
         source=NULL;
     }
-    if (sql_insert)
-    {
-        free(sql_insert);
-        sql_insert=NULL;
-    }
-    if (sql_update)
-    {
-        free(sql_update);
-        sql_update=NULL;
-    }
     if (title)
     {
         free(title);
@@ -627,8 +710,6 @@ void cXMLTVEvent::Clear()
 
 cXMLTVEvent::cXMLTVEvent()
 {
-    sql_insert=NULL;
-    sql_update=NULL;
     source=NULL;
     channelid=NULL;
     title=NULL;
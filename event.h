@@ -9,6 +9,8 @@
 #define _EVENT_H
 
 #include <time.h>
+#include <stdint.h>
+#include <sqlite3.h>
 #include <vdr/epg.h>
 
 class cXMLTVStringList : public cVector<char *>
@@ -29,6 +31,56 @@ public:
     virtual void Clear(void);
 };
 
+// parameters of the prepared insert and update statements of the epg table
+enum
+{
+    XMLTVPARAM_SRCID=1,
+    XMLTVPARAM_CHID,
+    XMLTVPARAM_EVENTID,
+    XMLTVPARAM_STARTTIME,
+    XMLTVPARAM_DURATION,
+    XMLTVPARAM_TITLE,
+    XMLTVPARAM_ALTTITLE,
+    XMLTVPARAM_ORIGTITLE,
+    XMLTVPARAM_SHORTTEXT,
+    XMLTVPARAM_DESCRIPTION,
+    XMLTVPARAM_COUNTRY,
+    XMLTVPARAM_YEAR,
+    XMLTVPARAM_CREDITS,
+    XMLTVPARAM_CATEGORY,
+    XMLTVPARAM_REVIEW,
+    XMLTVPARAM_RATING,
+    XMLTVPARAM_STARRATING,
+    XMLTVPARAM_VIDEO,
+    XMLTVPARAM_AUDIO,
+    XMLTVPARAM_SEASON,
+    XMLTVPARAM_EPISODE,
+    XMLTVPARAM_EPISODEOVERALL,
+    XMLTVPARAM_PICS,
+    XMLTVPARAM_SRCIDX,
+    XMLTVPARAM_HASH,
+    XMLTVPARAM_EPSTAMP,
+    XMLTVPARAMS=XMLTVPARAM_EPSTAMP
+};
+
+class cXMLTVValues
+{
+private:
+    struct value
+    {
+        int type;
+        sqlite3_int64 number;
+        char *text;
+    } values[XMLTVPARAMS+1];
+public:
+    cXMLTVValues();
+    ~cXMLTVValues();
+    void Clear();
+    void SetText(int Param, const char *Text);
+    void SetNumber(int Param, sqlite3_int64 Number);
+    int Bind(sqlite3_stmt *Stmt);
+};
+
 class cXMLTVEvent
 {
 private:
@@ -40,8 +92,6 @@ private:
     char *country;
     char *origtitle;
     char *audio;
-    char *sql_insert;
-    char *sql_update;
     char *channelid;
     char *source;
     int year;
@@ -92,7 +142,14 @@ public:
     void SetVideo(const char *Video);
     void SetPics(const char *Pics);
     void CreateEventID(time_t StartTime);
-    void GetSQL(const char *Source, int SrcIdx, const char *ChannelID, char **Insert, char **Update);
+    uint64_t Hash(int SrcIdx);
+    void GetSQLValues(sqlite3_int64 SrcID, int SrcIdx, cXMLTVValues *Values);
+    static sqlite3_int64 SourceKey(sqlite3 *Db, const char *Source);
+    static sqlite3_int64 ChannelKey(sqlite3 *Db, const char *ChannelID);
+    static const char *InsertSQL();
+    static const char *UpdateSQL();
+    static const char *UpsertSQL();
+    static bool HasUpsert();
     bool WeakID()
     {
         return weakid;
@@ -1239,10 +1239,9 @@ cXMLTVEvent *cImport::PrepareAndReturn(sqlite3 **db, char *sql)
         {
             if (strstr(errmsg,"no such column"))
             {
-                esyslog("sqlite3: database schema changed, unlinking epg.db!");
-                sqlite3_close(*db);
-                *db=NULL;
-                unlink(g->EPGFile());
+                // the next search uses the new columns
+                esyslog("sqlite3: database schema changed, upgrading epg.db");
+                g->UpgradeDB(*db);
             }
             else
             {
@@ -1365,26 +1364,39 @@ cXMLTVEvent *cImport::AddXMLTVEvent(cEPGSource *Source,sqlite3 *Db, const char *
         return NULL;
     }
 
-    char *isql,*usql;
-    xevent->GetSQL(Source->Name(),99,ChannelID,&isql,&usql);
-    if (isql && usql)
+    sqlite3_int64 srcid=cXMLTVEvent::SourceKey(Db,Source->Name());
+    sqlite3_int64 chid=cXMLTVEvent::ChannelKey(Db,ChannelID);
+    if ((srcid<0) || (chid<0))
     {
-        char *errmsg;
-        int ret=sqlite3_exec(Db,isql,NULL,NULL,&errmsg);
-        if (ret!=SQLITE_OK)
+        esyslogs(Source,"sqlite3: %s",sqlite3_errmsg(Db));
+        delete xevent;
+        return NULL;
+    }
+    cXMLTVValues values;
+    xevent->GetSQLValues(srcid,99,&values);
+    values.SetNumber(XMLTVPARAM_CHID,chid);
+    {
+        if (Db!=stmtdb)
         {
-            if (ret==SQLITE_CONSTRAINT)
-            {
-                sqlite3_free(errmsg);
-                ret=sqlite3_exec(Db,usql,NULL,NULL,&errmsg);
-            }
-            if (ret!=SQLITE_OK)
-            {
-                esyslogs(Source,"sqlite3: %s",errmsg);
-                sqlite3_free(errmsg);
-                delete xevent;
-                return NULL;
-            }
+            FinalizeStatements();
+            stmtdb=Db;
+        }
+        bool upsert=cXMLTVEvent::HasUpsert();
+        int ret=SQLITE_OK;
+        if (!addstmt) ret=sqlite3_prepare_v2(Db,upsert ? cXMLTVEvent::UpsertSQL() : cXMLTVEvent::InsertSQL(),
+                                             -1,&addstmt,NULL);
+        if (ret==SQLITE_OK) ret=Step(addstmt,values);
+        if ((ret==SQLITE_CONSTRAINT) && (!upsert))
+        {
+            ret=SQLITE_OK;
+            if (!updatestmt) ret=sqlite3_prepare_v2(Db,cXMLTVEvent::UpdateSQL(),-1,&updatestmt,NULL);
+            if (ret==SQLITE_OK) ret=Step(updatestmt,values);
+        }
+        if (ret!=SQLITE_DONE)
+        {
+            esyslogs(Source,"sqlite3: %s",sqlite3_errmsg(Db));
+            delete xevent;
+            return NULL;
         }
         /*
         if (ret==SQLITE_OK)
@@ -1426,9 +1438,11 @@ bool cImport::UpdateXMLTVEvent(cEPGSource *Source, sqlite3 *Db, cXMLTVEvent *xEv
             strcpy(shortdesc,ed.c_str());
         }
 
-        if (asprintf(&sql,"update epg set season=%li, episode=%li, episodeoverall=%li, shorttext='%s' "
-                     " where eventid=%li and src='%s' and channelid='%s'", (long int) xEvent->Season(),
+        if (asprintf(&sql,"update epg set season=%li, episode=%li, episodeoverall=%li, shorttext='%s', epstamp=%li "
+                     " where eventid=%li and srcid=(select srcid from sources where src='%s')"
+                     " and chid=(select chid from channels where channelid='%s')", (long int) xEvent->Season(),
                      (long int) xEvent->Episode(), (long int) xEvent->EpisodeOverall()   ,shortdesc,
+                     (long int) time(NULL),
                      (long int) xEvent->EventID(),Source->Name(),xEvent->ChannelID())==-1)
         {
             free(shortdesc);
@@ -1439,9 +1453,11 @@ bool cImport::UpdateXMLTVEvent(cEPGSource *Source, sqlite3 *Db, cXMLTVEvent *xEv
     }
     else
     {
-        if (asprintf(&sql,"update epg set season=%li, episode=%li, episodeoverall=%li "
-                     " where eventid=%li and src='%s' and channelid='%s'", (long int) xEvent->Season(),
+        if (asprintf(&sql,"update epg set season=%li, episode=%li, episodeoverall=%li, epstamp=%li "
+                     " where eventid=%li and srcid=(select srcid from sources where src='%s')"
+                     " and chid=(select chid from channels where channelid='%s')", (long int) xEvent->Season(),
                      (long int) xEvent->Episode(), (long int) xEvent->EpisodeOverall(),
+                     (long int) time(NULL),
                      (long int) xEvent->EventID(),Source->Name(),xEvent->ChannelID())==-1)
         {
             esyslogs(Source,"out of memory");
@@ -1537,8 +1553,9 @@ bool cImport::UpdateXMLTVEvent(cEPGSource *Source, sqlite3 *Db, const cEvent *Ev
         }
 
         if (asprintf(&sql,"update epg set eiteventid=%li, eitdescription='%s' where eventid=%li and "
-                     "src='%s' and channelid='%s'",(long int) Event->EventID(),eitdescription,
-                     (long int) xEvent->EventID(),Source->Name(),*Event->ChannelID().ToString())==-1)
+                     "srcid=(select srcid from sources where src='%s') and "
+                     "chid=(select chid from channels where channelid='%s')",(long int) Event->EventID(),
+                     eitdescription,(long int) xEvent->EventID(),Source->Name(),*Event->ChannelID().ToString())==-1)
         {
             free(eitdescription);
             esyslogs(Source,"out of memory");
@@ -1548,9 +1565,10 @@ bool cImport::UpdateXMLTVEvent(cEPGSource *Source, sqlite3 *Db, const cEvent *Ev
     }
     else
     {
-        if (asprintf(&sql,"update epg set eiteventid=%li where eventid=%li and src='%s' and "
-                     "channelid='%s'",(long int) Event->EventID(),(long int) xEvent->EventID(),
-                     Source->Name(),*Event->ChannelID().ToString())==-1)
+        if (asprintf(&sql,"update epg set eiteventid=%li where eventid=%li and "
+                     "srcid=(select srcid from sources where src='%s') and "
+                     "chid=(select chid from channels where channelid='%s')",(long int) Event->EventID(),
+                     (long int) xEvent->EventID(),Source->Name(),*Event->ChannelID().ToString())==-1)
         {
             esyslogs(Source,"out of memory");
             return false;
@@ -1596,8 +1614,9 @@ cXMLTVEvent *cImport::SearchXMLTVEvent(sqlite3 **Db,const char *ChannelID, const
     if (!Db) return NULL;
     if (!*Db)
     {
-        // we need READWRITE because the epg.db maybe updated later
-        if (sqlite3_open_v2(g->EPGFile(),Db,SQLITE_OPEN_READWRITE,NULL)!=SQLITE_OK)
+        // we need READWRITE because the epg.db maybe updated later,
+        // never wait for the lock in the epg handler
+        if (g->OpenDB(Db,SQLITE_OPEN_READWRITE,0)!=SQLITE_OK)
         {
             esyslog("failed to open %s",g->EPGFile());
             *Db=NULL;
@@ -1613,10 +1632,11 @@ cXMLTVEvent *cImport::SearchXMLTVEvent(sqlite3 **Db,const char *ChannelID, const
     if (eventTimeDiff<100) eventTimeDiff=100;
     if (eventTimeDiff>720) eventTimeDiff=720;
 
-    if (asprintf(&sql,"select channelid,eventid,starttime,duration,title,origtitle,shorttext,description," \
+    if (asprintf(&sql,"select channels.channelid,eventid,starttime,duration,title,origtitle,shorttext,description," \
                  "country,year,credits,category,review,rating,starrating,video,audio,season,episode," \
-                 "episodeoverall,pics,src,eiteventid,eitdescription,alttitle,abs(starttime-%li) as diff from epg where " \
-                 " (starttime>=%li and starttime<=%li) and eiteventid=%u and channelid='%s' " \
+                 "episodeoverall,pics,sources.src,eiteventid,eitdescription,alttitle,abs(starttime-%li) as diff " \
+                 "from epg join channels using (chid) join sources using (srcid) where " \
+                 " (starttime>=%li and starttime<=%li) and eiteventid=%u and channels.channelid='%s' " \
                  " order by diff,srcidx asc limit 1;",Event->StartTime(),Event->StartTime()-eventTimeDiff,
                  Event->StartTime()+eventTimeDiff,Event->EventID(),ChannelID)==-1)
     {
@@ -1638,10 +1658,11 @@ cXMLTVEvent *cImport::SearchXMLTVEvent(sqlite3 **Db,const char *ChannelID, const
         else
         {
 
-            if (asprintf(&sql,"select channelid,eventid,starttime,duration,title,origtitle,shorttext,description," \
+            if (asprintf(&sql,"select channels.channelid,eventid,starttime,duration,title,origtitle,shorttext,description," \
                          "country,year,credits,category,review,rating,starrating,video,audio,season,episode," \
-                         "episodeoverall,pics,src,eiteventid,eitdescription,alttitle,abs(starttime-%li) as diff from epg where " \
-                         " (starttime>=%li and starttime<=%li) and soundex(title)='%s' and channelid='%s' " \
+                         "episodeoverall,pics,sources.src,eiteventid,eitdescription,alttitle,abs(starttime-%li) as diff " \
+                         "from epg join channels using (chid) join sources using (srcid) where " \
+                         " (starttime>=%li and starttime<=%li) and soundex(title)='%s' and channels.channelid='%s' " \
                          " order by diff,srcidx asc limit 1;",Event->StartTime(),Event->StartTime()-eventTimeDiff,
                          Event->StartTime()+eventTimeDiff,wstr,ChannelID)==-1)
             {
@@ -1678,10 +1699,11 @@ cXMLTVEvent *cImport::SearchXMLTVEvent(sqlite3 **Db,const char *ChannelID, const
             }
         }
 
-        if (asprintf(&sql,"select channelid,eventid,starttime,duration,title,origtitle,shorttext,description," \
+        if (asprintf(&sql,"select channels.channelid,eventid,starttime,duration,title,origtitle,shorttext,description," \
                      "country,year,credits,category,review,rating,starrating,video,audio,season,episode," \
-                     "episodeoverall,pics,src,eiteventid,eitdescription,abs(starttime-%li) as diff from epg where " \
-                     " (starttime>=%li and starttime<=%li) and title='%s' and channelid='%s' " \
+                     "episodeoverall,pics,sources.src,eiteventid,eitdescription,abs(starttime-%li) as diff " \
+                     "from epg join channels using (chid) join sources using (srcid) where " \
+                     " (starttime>=%li and starttime<=%li) and title='%s' and channels.channelid='%s' " \
                      " order by diff,srcidx asc limit 1;",Event->StartTime(),Event->StartTime()-eventTimeDiff,
                      Event->StartTime()+eventTimeDiff,sqltitle,ChannelID)==-1)
         {
@@ -1695,6 +1717,24 @@ cXMLTVEvent *cImport::SearchXMLTVEvent(sqlite3 **Db,const char *ChannelID, const
     return PrepareAndReturn(Db,sql);
 }
 
+int cImport::Step(sqlite3_stmt *Stmt, cXMLTVValues &Values)
+{
+    int ret=Values.Bind(Stmt);
+    if (ret==SQLITE_OK) ret=sqlite3_step(Stmt);
+    // the values don't outlive this call
+    sqlite3_reset(Stmt);
+    sqlite3_clear_bindings(Stmt);
+    return ret;
+}
+
+void cImport::FinalizeStatements()
+{
+    if (addstmt) sqlite3_finalize(addstmt);
+    if (updatestmt) sqlite3_finalize(updatestmt);
+    addstmt=updatestmt=NULL;
+    stmtdb=NULL;
+}
+
 bool cImport::Begin(cEPGSource *Source, sqlite3 *Db)
 {
     if (!Source) return false;
@@ -1719,6 +1759,8 @@ bool cImport::Begin(cEPGSource *Source, sqlite3 *Db)
 bool cImport::Commit(cEPGSource *Source, sqlite3 *Db)
 {
     if (!Db) return false;
+    // the connection is closed after the commit
+    if (Db==stmtdb) FinalizeStatements();
     if (pendingtransaction)
     {
         char *errmsg;
@@ -1818,7 +1860,7 @@ int cImport::Process(cEPGSource *Source, cEPGExecutor &myExecutor)
 
     dsyslogs(Source,"importing from db");
     sqlite3 *db=NULL;
-    if (sqlite3_open_v2(g->EPGFile(),&db,SQLITE_OPEN_READWRITE,NULL)!=SQLITE_OK)
+    if (g->OpenDB(&db,SQLITE_OPEN_READWRITE)!=SQLITE_OK)
     {
         esyslogs(Source,"failed to open %s",g->EPGFile());
 #if VDRVERSNUM<20301
@@ -1832,11 +1874,7 @@ int cImport::Process(cEPGSource *Source, cEPGExecutor &myExecutor)
     }
 
     char *sql;
-    if (asprintf(&sql,"select channelid,eventid,starttime,duration,title,origtitle,shorttext,description," \
-                 "country,year,credits,category,review,rating,starrating,video,audio,season,episode,episodeoverall," \
-                 "pics,src,eiteventid,eitdescription from epg where (starttime > %li or " \
-                 " (starttime + duration) > %li) and (starttime + duration) < %li "\
-                 " and src='%s' order by channelid,starttime;",begin,begin,end,Source->Name())==-1)
+    if (asprintf(&sql,EPGDBWINDOWSQL,Source->Name(),begin,end)==-1)
     {
         sqlite3_close(db);
         esyslogs(Source,"out of memory");
@@ -2035,6 +2073,8 @@ cImport::cImport(cGlobals *Global)
 {
     g=Global;
     pendingtransaction=false;
+    stmtdb=NULL;
+    addstmt=updatestmt=NULL;
     conv = new cCharSetConv("UTF-8",g->Codeset());
 
     if (Global->EPDir())
@@ -2051,6 +2091,7 @@ cImport::cImport(cGlobals *Global)
 
 cImport::~cImport()
 {
+    FinalizeStatements();
     if (cep2ascii!=(iconv_t) -1) iconv_close(cep2ascii);
     if (cutf2ascii!=(iconv_t) -1) iconv_close(cutf2ascii);
     delete conv;
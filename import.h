@@ -43,6 +43,11 @@ private:
     iconv_t cep2ascii;
     iconv_t cutf2ascii;
     bool pendingtransaction;
+    sqlite3 *stmtdb;
+    sqlite3_stmt *addstmt;
+    sqlite3_stmt *updatestmt;
+    int Step(sqlite3_stmt *Stmt, cXMLTVValues &Values);
+    void FinalizeStatements();
     char *RemoveLastCharFromDescription(char *description);
     char *Add2Description(char *description, const char *value);
     char *Add2Description(char *description, const char *name, const char *value);
@@ -55,7 +60,6 @@ private:
     cEvent *SearchVDREventByTitle(cEPGSource *source, cSchedule* schedule, const char *Title, time_t StartTime,
                                   int Duration, int hint);
     bool FetchXMLTVEvent(sqlite3_stmt *stmt, cXMLTVEvent *xevent);
-    char *RemoveNonASCII(const char *src);
     cXMLTVEvent *PrepareAndReturn(sqlite3 **db, char *sql);
     int SoundEx(char *SoundEx,char *WordString,int LengthOption,int CensusOption);
 public:
@@ -77,6 +81,7 @@ public:
                                const cEvent *Event, const char *EITDescription, bool UseEPText);
     bool AddShortTextFromEITDescription(cXMLTVEvent *xEvent, const char *EITDescription);
     bool WasChanged(cEvent *Event);
+    static char *RemoveNonASCII(const char *src);
 };
 
 #endif
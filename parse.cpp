@@ -16,195 +16,210 @@
 #include <time.h>
 #include <pwd.h>
 #include <iconv.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 #include <vdr/timers.h>
 #include <vdr/tools.h>
 #include <sqlite3.h>
 
 #include "xmltv2vdr.h"
 #include "parse.h"
+#include "eplists.h"
 #include "debug.h"
 
 // -------------------------------------------------------
 
-time_t cParse::ConvertXMLTVTime2UnixTime(char *xmltvtime)
+// 1: kept (0x30-0x39, 0x41-0x5A, 0x61-0x7A), 2: 'i', maybe followed by 'e'
+static const unsigned char alphanumeric[256]=
 {
-    time_t offset=0;
-    if (!xmltvtime) return (time_t) 0;
-    char *withtz=strchr(xmltvtime,' ');
-    int len;
-    if (withtz)
-    {
-        len=strlen(xmltvtime)-(withtz-xmltvtime)-1;
-        *withtz=':';
-        if ((withtz[1]=='+') || (withtz[1]=='-'))
-        {
-            if (len==5)
-            {
-                int val=atoi(&withtz[1]);
-                int h=val/100;
-                int m=val-(h*100);
-                offset=h*3600+m*60;
-                setenv("TZ",":UTC",1);
-            }
-            else
-            {
-                setenv("TZ",":UTC",1);
-            }
-        }
-        else
-        {
-            if (len>2)
-            {
-                setenv("TZ",withtz,1);
-            }
-            else
-            {
-                setenv("TZ",":UTC",1);
-            }
-        }
-    }
-    else
-    {
-        withtz=&xmltvtime[strlen(xmltvtime)];
-        setenv("TZ",":UTC",1);
-    }
-    tzset();
+    0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0, 0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,
+    0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0, 1,1,1,1,1,1,1,1,1,1,0,0,0,0,0,0,
+    0,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1, 1,1,1,1,1,1,1,1,1,1,1,0,0,0,0,0,
+    0,1,1,1,1,1,1,1,1,2,1,1,1,1,1,1, 1,1,1,1,1,1,1,1,1,1,1,0,0,0,0,0
+};
 
-    len=withtz-xmltvtime;
-    if (len<4)
-    {
-        unsetenv("TZ");
-        tzset();
-        return (time_t) 0;
-    }
-    len-=2;
-    char fmt[]="%Y%m%d%H%M%S";
-    fmt[len]=0;
-
-    struct tm tm;
-    memset(&tm,0,sizeof(tm));
-    if (!strptime(xmltvtime,fmt,&tm))
+static inline void removenonalphanumeric(const unsigned char *&r, const unsigned char *e, char *&w)
+{
+    unsigned char c=*r++;
+    switch (alphanumeric[c])
     {
-        unsetenv("TZ");
-        tzset();
-        return (time_t) 0;
+    case 1:
+        *w++=c;
+        break;
+    case 2:
+        if ((r<e) && (*r=='e'))
+        {
+            // "ie" -> "y"
+            c='y';
+            r++;
+        }
+        *w++=c;
+        break;
+    default:
+        break;
     }
-    if (tm.tm_mday==0) tm.tm_mday=1;
-    time_t ret=mktime(&tm);
-    ret-=offset;
-    unsetenv("TZ");
-    tzset();
-    return ret;
 }
 
 void cParse::RemoveNonAlphaNumeric(char *String, bool InDescription)
 {
+    // one pass over the string, with the same result as removing the
+    // markers and characters one by one
     if (!String) return;
 
     // remove " Teil " (special for .episodes files)
-    int len=strlen(String);
+    size_t len=strlen(String);
     char *p=strstr(String," Teil ");
     if (!p) p=strstr(String,"(Teil ");
-    if (p)
+    if (p==String)
     {
+        // the terminating zero stays where it was
         memmove(p,p+6,len-6);
     }
+    else if (p)
+    {
+        memmove(p,p+6,len-(p-String)-5);
+        len-=6;
+    }
 
-    // cut off " Dramedy,"
-    len=strlen(String);
-    p=String;
-    p=strstr(String," Dramedy,");
-    if (p) *p=0;
-
-    // cut off " Krimi,"
-    len=strlen(String);
-    p=String;
-    p=strstr(String," Krimi,");
-    if (p) *p=0;
-
-    // cut off " Familie,"
-    len=strlen(String);
-    p=String;
-    p=strstr(String," Familie,");
-    if (p) *p=0;
-
-    // cut off " Western,"
-    len=strlen(String);
-    p=String;
-    p=strstr(String," Western,");
-    if (p) *p=0;
-
-    len=strlen(String);
-    p=String;
-    // cut off " Folge XX" at end
-    p=strstr(String," Folge ");
-    if (p) *p=0;
+    // cut off " Dramedy,", " Krimi,", " Familie,", " Western," and
+    // " Folge XX" at end, each one only if it's left by the ones before
+    static const struct
+    {
+        const char *text;
+        size_t len;
+    } cuts[]=
+    {
+        { " Dramedy,",9 },
+        { " Krimi,",7 },
+        { " Familie,",9 },
+        { " Western,",9 },
+        { " Folge ",7 }
+    };
+    const int numcuts=sizeof(cuts)/sizeof(cuts[0]);
+    size_t first[numcuts];
+    int missing=numcuts;
+    for (int i=0; i<numcuts; i++) first[i]=len;
+    p=(char *) memchr(String,' ',len);
+    while ((p) && (missing))
+    {
+        size_t pos=p-String;
+        int i;
+        switch (p[1])
+        {
+        case 'D':
+            i=0;
+            break;
+        case 'K':
+            i=1;
+            break;
+        case 'F':
+            i=(p[2]=='a') ? 2 : 4;
+            break;
+        case 'W':
+            i=3;
+            break;
+        default:
+            i=-1;
+            break;
+        }
+        if ((i!=-1) && (first[i]==len) && (pos+cuts[i].len<=len) &&
+                (!memcmp(p,cuts[i].text,cuts[i].len)))
+        {
+            first[i]=pos;
+            missing--;
+        }
+        p=(char *) memchr(p+1,' ',len-pos-1);
+    }
+    size_t end=len;
+    for (int i=0; i<numcuts; i++)
+    {
+        if ((first[i]!=len) && (first[i]+cuts[i].len<=end)) end=first[i];
+    }
 
+    size_t start=0;
     bool bCutNumbers=false;
-    len=strlen(String);
-    p=String;
     // cut off "Folge XX" at start
-    if (!strncmp(String,"Folge ",6))
+    if ((end>=6) && (!strncmp(String,"Folge ",6)))
     {
-        memmove(p,p+6,len-6);
-        String[len-6]=0;
+        start=6;
         bCutNumbers=true;
     }
 
     if (InDescription || bCutNumbers)
     {
         // remove leading numbers (inkl. roman numerals)
-        len=strlen(String);
-        p=String;
-        while (*p)
+        while (start<end)
         {
-            // 0x30 - 0x39
-            if (((*p>=0x30) && (*p<=0x39)) || (*p=='I') || (*p=='V') || (*p=='X') || (*p=='/'))
+            char c=String[start];
+            if (((c>=0x30) && (c<=0x39)) || (c=='I') || (c=='V') || (c=='X') || (c=='/'))
             {
-                memmove(p,p+1,len);
-                len--;
+                start++;
                 continue;
             }
-            else
-            {
-                break;
-            }
+            break;
         }
     }
 
-    // remove non alphanumeric characters
-    len=strlen(String);
-    p=String;
-    int pos=0;
-    while (*p)
+    // remove non alphanumeric characters (keep 0x30-0x39, 0x41-0x5A
+    // and 0x61-0x7A) and replace "ie" with "y"
+    const unsigned char *r=(const unsigned char *) String+start;
+    const unsigned char *e=(const unsigned char *) String+end;
+    char *w=String;
+#ifdef __SSE2__
+    const __m128i c0=_mm_set1_epi8(0x30-1),c9=_mm_set1_epi8(0x39+1);
+    const __m128i ca=_mm_set1_epi8(0x61-1),cz=_mm_set1_epi8(0x7a+1);
+    const __m128i lower=_mm_set1_epi8(0x20);
+    const __m128i ci=_mm_set1_epi8('i'),ce=_mm_set1_epi8('e');
+    while (r+17<=e)
     {
-        // 0x30 - 0x39
-        // 0x41 - 0x5A
-        // 0x61 - 0x7A
-        if ((*p<0x30) || (*p>0x7a) || (*p>0x39 && *p<0x41) || (*p>0x5A && *p< 0x61))
+        // classify 16 characters at once
+        __m128i c=_mm_loadu_si128((const __m128i *) r);
+        __m128i n=_mm_loadu_si128((const __m128i *)(r+1));
+        __m128i l=_mm_or_si128(c,lower);
+        __m128i keep=_mm_or_si128(_mm_and_si128(_mm_cmpgt_epi8(c,c0),_mm_cmplt_epi8(c,c9)),
+                                  _mm_and_si128(_mm_cmpgt_epi8(l,ca),_mm_cmplt_epi8(l,cz)));
+        __m128i ie=_mm_and_si128(_mm_cmpeq_epi8(c,ci),_mm_cmpeq_epi8(n,ce));
+        unsigned int mask=_mm_movemask_epi8(keep);
+        unsigned int iemask=_mm_movemask_epi8(ie);
+        if ((mask==0xffff) && (!iemask))
         {
-            memmove(p,p+1,len-pos);
-            len--;
+            if (w!=(char *) r) _mm_storeu_si128((__m128i *) w,c);
+            w+=16;
+            r+=16;
             continue;
         }
-        if ((*p=='i') && (*(p+1) && *(p+1)=='e'))
+        int len=16;
+        while (mask)
         {
-            memmove(p,p+1,len-pos);
-            len--;
-            *p='y';
-            continue;
+            int i=__builtin_ctz(mask);
+            mask&=mask-1;
+            if (iemask & (1U<<i))
+            {
+                // "ie" -> "y", the 'e' may be the first one of the next block
+                *w++='y';
+                if (i==15)
+                    len=17;
+                else
+                    mask&=~(1U<<(i+1));
+            }
+            else
+            {
+                *w++=r[i];
+            }
         }
-        p++;
-        pos++;
+        r+=len;
     }
-
+#endif
+    while (r<e) removenonalphanumeric(r,e,w);
+    *w=0;
     return;
 }
 
 bool cParse::FetchSeasonEpisode(iconv_t cEP2ASCII, iconv_t cUTF2ASCII, const char *EPDir,
                                 const char *Title, const char *ShortText, const char *Description,
                                 int &Season, int &Episode, int &EpisodeOverall, char **EPShortText,
-                                char **EPTitle)
+                                char **EPTitle, int *NotFound)
 {
     EpisodeOverall=0;
 
@@ -214,38 +229,9 @@ bool cParse::FetchSeasonEpisode(iconv_t cEP2ASCII, iconv_t cUTF2ASCII, const cha
     if (cEP2ASCII==(iconv_t) -1) return false;
     if (cUTF2ASCII==(iconv_t) -1) return false;
 
-    DIR *dir=opendir(EPDir);
-    if (!dir) return false;
-    struct dirent *dirent;
     char *fTitle=NULL;
-    for (;;)
-    {
-        dirent = readdir(dir);
-        if (!dirent) break;
-        if (dirent->d_name[0]=='.') continue;
-        char *pt=strrchr(dirent->d_name,'.');
-        if (pt) *pt=0;
-        int dlen=strlen(dirent->d_name);
-        if (!strncasecmp(dirent->d_name,Title,dlen))
-        {
-            int tlen=strlen(Title);
-            if (tlen>dlen)
-            {
-                if (Title[dlen]==32)
-                {
-                    if (fTitle) free(fTitle);
-                    fTitle=strdup(dirent->d_name);
-                }
-            }
-            else
-            {
-                if (fTitle) free(fTitle);
-                fTitle=strdup(dirent->d_name);
-                break;
-            }
-        }
-    }
-    closedir(dir);
+    const char *suffix;
+    if (!EPLists.Find(EPDir,Title,&fTitle,&suffix)) return false;
 
     int f_season=Season,f_episode=Episode;
     size_t slen;
@@ -294,14 +280,15 @@ bool cParse::FetchSeasonEpisode(iconv_t cEP2ASCII, iconv_t cUTF2ASCII, const cha
     }
 
     char *epfile=NULL;
-    if (asprintf(&epfile,"%s/%s.episodes",EPDir,fTitle)==-1)
+    if (asprintf(&epfile,"%s/%s%s",EPDir,fTitle,suffix)==-1)
     {
         free(fTitle);
         return false;
     }
 
-    FILE *f=fopen(epfile,"r");
-    if (!f)
+    // the file is parsed once and kept in the cache
+    char *linkname=NULL;
+    if (!EPLists.Load(epfile,cEP2ASCII,&linkname))
     {
         free(epfile);
         free(fTitle);
@@ -309,29 +296,11 @@ bool cParse::FetchSeasonEpisode(iconv_t cEP2ASCII, iconv_t cUTF2ASCII, const cha
     }
 
     char dname[2048]="";
-    if (readlink(epfile,dname,sizeof(dname)-1)!=-1)
-    {
-        char *ls=strrchr(dname,'/');
-        if (ls)
-        {
-            ls++;
-            memmove(dname,ls,strlen(ls)+1);
-        }
-        char *pt=strrchr(dname,'.');
-        if (pt)
-        {
-            *pt=0;
-        }
-        else
-        {
-            dname[0]=0;
-        }
-    }
-    else
+    if (linkname)
     {
-        dname[0]=0;
+        strn0cpy(dname,linkname,sizeof(dname)-1);
+        free(linkname);
     }
-
     if (dname[0]==0) strn0cpy(dname,fTitle,sizeof(dname)-1);
     free(fTitle);
 
@@ -339,7 +308,6 @@ bool cParse::FetchSeasonEpisode(iconv_t cEP2ASCII, iconv_t cUTF2ASCII, const cha
 
     if ((!ShortText) && (!Description))
     {
-        fclose(f);
         free(epfile);
         return false;
     }
@@ -352,7 +320,6 @@ bool cParse::FetchSeasonEpisode(iconv_t cEP2ASCII, iconv_t cUTF2ASCII, const cha
     }
     if (!slen)
     {
-        fclose(f);
         free(epfile);
         return false;
     }
@@ -361,7 +328,6 @@ bool cParse::FetchSeasonEpisode(iconv_t cEP2ASCII, iconv_t cUTF2ASCII, const cha
     char *dshorttext=(char *) calloc(dlen,1);
     if (!dshorttext)
     {
-        fclose(f);
         free(epfile);
         return false;
     }
@@ -372,7 +338,6 @@ bool cParse::FetchSeasonEpisode(iconv_t cEP2ASCII, iconv_t cUTF2ASCII, const cha
     {
         tsyslog("failed to convert '%s'->'%s' (1)",ShortText,dshorttext);
         free(dshorttext);
-        fclose(f);
         free(epfile);
         return false;
     }
@@ -396,112 +361,14 @@ bool cParse::FetchSeasonEpisode(iconv_t cEP2ASCII, iconv_t cUTF2ASCII, const cha
 #endif
     tsyslog("trying to find season/episode for '%s' with '%s'",Title,dshorttext);
 
-    char *line=NULL;
-    size_t length = 0;
-    bool found=false;
-    if (EPShortText) *EPShortText=NULL;
-    size_t charlen=0;
-    int tmpSeason=-1,tmpEpisode=-1,tmpEpisodeOverall=-1;
-    while (getline(&line,&length,f)!=-1)
-    {
-        if (line==NULL) 
-	{
-	    length = 0;
-	    continue;
-	}
-        if (line[0]=='#') continue;
-        char epshorttext[256]="";
-        if (sscanf(line,"%3d\t%3d\t%5d\t%255c",&Season,&Episode,&EpisodeOverall,epshorttext)==4)
-        {
-            char depshorttext[1024]="";
-            char *lf=strchr(epshorttext,'\n');
-            if (lf) *lf=0;
-            char *tab=strchr(epshorttext,'\t');
-            if (tab) *tab=0;
-            slen=strlen(epshorttext);
-            dlen=sizeof(depshorttext);
-            FromPtr=(char *) epshorttext;
-            ToPtr=(char *) depshorttext;
-            if (iconv(cEP2ASCII,&FromPtr,&slen,&ToPtr,&dlen)!=(size_t) -1)
-            {
-                RemoveNonAlphaNumeric(depshorttext);
-                if (!strlen(depshorttext))
-                {
-                    strcpy(depshorttext,epshorttext); // ok lets try with the original text
-                }
-#ifdef DEBCMP
-                tsyslog("depshorttext=%s",depshorttext);
-#endif
-                if (!strcasecmp(dshorttext,depshorttext))
-                {
-                    // exact match
-                    if (EPShortText)
-                    {
-                        if (*EPShortText) free(*EPShortText);
-                        *EPShortText=strdup(epshorttext);
-                    }
-                    found=true;
-                    break;
-                }
-
-                dlen=strlen(depshorttext);
-                if (!strncasecmp(dshorttext,depshorttext,dlen))
-                {
-                    // not exact match -> maybe better match available?
-                    if (dlen>charlen)
-                    {
-                        if (EPShortText)
-                        {
-                            if (*EPShortText) free(*EPShortText);
-                            *EPShortText=strdup(epshorttext);
-                            tmpSeason=Season;
-                            tmpEpisode=Episode;
-                            tmpEpisodeOverall=EpisodeOverall;
-                        }
-                        charlen=dlen;
-                        found=true;
-                    }
-                }
-
-                if ((f_season==Season) && (f_episode==Episode))
-                {
-                    if (!strcasecmp(epshorttext,"n.n."))
-                    {
-                        if (EPShortText)
-                        {
-                            if (*EPShortText) free(*EPShortText);
-                            *EPShortText=strdup("@");
-                        }
-                        isyslog("failed to find '%s' for '%s' in eplists*",ShortText,Title);
-                    }
-                    else
-                    {
-                        if (EPShortText)
-                        {
-                            if (*EPShortText) free(*EPShortText);
-                            *EPShortText=strdup(epshorttext);
-                        }
-                    }
-                    found=true;
-                    break;
-                }
-            }
-            else
-            {
-                tsyslog("failed to convert '%s'->'%s' (2)",epshorttext,depshorttext);
-            }
-        }
-        else
-        {
-            tsyslog("failed to parse '%s' in '%s'",line,epfile);
-        }
-    }
-    if (tmpEpisode!=-1)
-    {
-        Season=tmpSeason;
-        Episode=tmpEpisode;
-        EpisodeOverall=tmpEpisodeOverall;
-    }
+    // no fuzzy search if season and episode are already known
+    bool fuzzy=(ShortText) && ((f_season<=0) || (f_episode<=0));
+    bool notnamed;
+    bool found=EPLists.Match(epfile,cEP2ASCII,dshorttext,f_season,f_episode,Season,Episode,
+                             EpisodeOverall,EPShortText,&notnamed,fuzzy);
+    // misses are only counted, if the caller wants to
+    bool missed=notnamed;
+    if ((notnamed) && (!NotFound)) isyslog("failed to find '%s' for '%s' in eplists*",ShortText,Title);
 
     if (!found)
     {
@@ -509,7 +376,8 @@ bool cParse::FetchSeasonEpisode(iconv_t cEP2ASCII, iconv_t cUTF2ASCII, const cha
         Episode=0;
         if (ShortText)
         {
-            isyslog("failed to find '%s' for '%s' in eplists",ShortText,Title);
+            if (!NotFound) isyslog("failed to find '%s' for '%s' in eplists",ShortText,Title);
+            missed=true;
             if ((f_season>0) && (f_episode>0))
             {
                 if (EPShortText)
@@ -531,14 +399,104 @@ bool cParse::FetchSeasonEpisode(iconv_t cEP2ASCII, iconv_t cUTF2ASCII, const cha
             tsyslog("found shorttext '%s' with description of '%s'",*EPShortText,Title);
         }
     }
-    if (line) free(line);
-    fclose(f);
-
+    if ((missed) && (NotFound)) (*NotFound)++;
     free(dshorttext);
     free(epfile);
     return found;
 }
 
+int cParse::LookupElement(const xmlChar *Name)
+{
+    static const struct
+    {
+        const char *name;
+        int element;
+    } elementnames[]=
+    {
+        { "programme", ELEMENT_PROGRAMME },
+        { "title", ELEMENT_TITLE },
+        { "sub-title", ELEMENT_SUBTITLE },
+        { "desc", ELEMENT_DESC },
+        { "credits", ELEMENT_CREDITS },
+        { "date", ELEMENT_DATE },
+        { "category", ELEMENT_CATEGORY },
+        { "country", ELEMENT_COUNTRY },
+        { "video", ELEMENT_VIDEO },
+        { "audio", ELEMENT_AUDIO },
+        { "rating", ELEMENT_RATING },
+        { "star-rating", ELEMENT_STARRATING },
+        { "review", ELEMENT_REVIEW },
+        { "icon", ELEMENT_ICON },
+        { "episode-num", ELEMENT_EPISODENUM },
+        { "length", ELEMENT_IGNORE },
+        { "subtitles", ELEMENT_IGNORE },
+        { "new", ELEMENT_IGNORE },
+        { "premiere", ELEMENT_IGNORE },
+        { "previously-shown", ELEMENT_IGNORE },
+        { "live", ELEMENT_IGNORE },
+        { "actor", ELEMENT_ACTOR },
+        { "colour", ELEMENT_COLOUR },
+        { "aspect", ELEMENT_ASPECT },
+        { "quality", ELEMENT_QUALITY },
+        { "stereo", ELEMENT_STEREO },
+        { "value", ELEMENT_VALUE }
+    };
+    for (size_t i=0; i<sizeof(elementnames)/sizeof(elementnames[0]); i++)
+    {
+        if ((tolower(Name[0])==elementnames[i].name[0]) &&
+                (!xmlStrcasecmp(Name,(const xmlChar *) elementnames[i].name))) return elementnames[i].element;
+    }
+    return ELEMENT_UNKNOWN;
+}
+
+struct cParse::elementcache *cParse::ElementCache(const xmlChar *Name)
+{
+    // keyed by the name itself, the nodes of the workers are copies
+    // and don't share the dictionary of the reader
+    unsigned int hash=2166136261U;
+    for (const xmlChar *p=Name; *p; p++) hash=(hash ^ *p)*16777619U;
+    for (int i=0; i<ELEMENTCACHESIZE; i++)
+    {
+        struct elementcache *slot=&elements[(hash+i) & (ELEMENTCACHESIZE-1)];
+        if (!slot->name)
+        {
+            slot->name=xmlStrdup(Name);
+            if (!slot->name) return NULL;
+            slot->hash=hash;
+            slot->element=LookupElement(Name);
+            return slot;
+        }
+        if ((slot->hash==hash) && (xmlStrEqual(slot->name,Name))) return slot;
+    }
+    return NULL;
+}
+
+int cParse::ElementType(const xmlChar *Name)
+{
+    struct elementcache *slot=ElementCache(Name);
+    if (slot) return slot->element;
+    return LookupElement(Name);
+}
+
+void cParse::UnknownElement(const xmlChar *Name)
+{
+    // report every unknown element only once per parse, workers
+    // report to the cParse which started them
+    cParse *parse=master ? master : this;
+    cMutexLock lock(&parse->unknownmutex);
+    int idx=parse->unknownnames.Find((const char *) Name);
+    if (idx<0)
+    {
+        parse->unknownnames.Append(strdup((const char *) Name));
+        parse->unknowncounts.Append(1);
+        esyslogs(source,"unknown element %s, please report!",Name);
+    }
+    else
+    {
+        parse->unknowncounts[idx]++;
+    }
+}
+
 bool cParse::FetchEvent(xmlNodePtr enode, bool useeptext)
 {
     char *slang=getenv("LANG");
@@ -566,7 +524,8 @@ bool cParse::FetchEvent(xmlNodePtr enode, bool useeptext)
         }
         if (node->type==XML_ELEMENT_NODE)
         {
-            if ((!xmlStrcasecmp(node->name, (const xmlChar *) "title")))
+            int element=ElementType(node->name);
+            if (element==ELEMENT_TITLE)
             {
                 xmlChar *lang=xmlGetProp(node,(const xmlChar *) "lang");
                 xmlChar *content=xmlNodeListGetString(node->doc,node->xmlChildrenNode,1);
@@ -591,7 +550,7 @@ bool cParse::FetchEvent(xmlNodePtr enode, bool useeptext)
                 }
                 if (lang) xmlFree(lang);
             }
-            else if ((!xmlStrcasecmp(node->name, (const xmlChar *) "sub-title")))
+            else if (element==ELEMENT_SUBTITLE)
             {
                 // what to do with attribute lang?
                 xmlChar *content=xmlNodeListGetString(node->doc,node->xmlChildrenNode,1);
@@ -601,7 +560,7 @@ bool cParse::FetchEvent(xmlNodePtr enode, bool useeptext)
                     xmlFree(content);
                 }
             }
-            else if ((!xmlStrcasecmp(node->name, (const xmlChar *) "desc")))
+            else if (element==ELEMENT_DESC)
             {
                 // what to do with attribute lang?
                 xmlChar *content=xmlNodeListGetString(node->doc,node->xmlChildrenNode,1);
@@ -611,14 +570,14 @@ bool cParse::FetchEvent(xmlNodePtr enode, bool useeptext)
                     xmlFree(content);
                 }
             }
-            else if ((!xmlStrcasecmp(node->name, (const xmlChar *) "credits")))
+            else if (element==ELEMENT_CREDITS)
             {
                 xmlNodePtr vnode=node->xmlChildrenNode;
                 while (vnode)
                 {
                     if (vnode->type==XML_ELEMENT_NODE)
                     {
-                        if ((!xmlStrcasecmp(vnode->name, (const xmlChar *) "actor")))
+                        if (ElementType(vnode->name)==ELEMENT_ACTOR)
                         {
                             xmlChar *content=xmlNodeListGetString(vnode->doc,vnode->xmlChildrenNode,1);
                             if (content)
@@ -642,7 +601,7 @@ bool cParse::FetchEvent(xmlNodePtr enode, bool useeptext)
                     vnode=vnode->next;
                 }
             }
-            else if ((!xmlStrcasecmp(node->name, (const xmlChar *) "date")))
+            else if (element==ELEMENT_DATE)
             {
                 xmlChar *content=xmlNodeListGetString(node->doc,node->xmlChildrenNode,1);
                 if (content)
@@ -651,7 +610,7 @@ bool cParse::FetchEvent(xmlNodePtr enode, bool useeptext)
                     xmlFree(content);
                 }
             }
-            else if ((!xmlStrcasecmp(node->name, (const xmlChar *) "category")))
+            else if (element==ELEMENT_CATEGORY)
             {
                 // what to do with attribute lang?
                 xmlChar *content=xmlNodeListGetString(node->doc,node->xmlChildrenNode,1);
@@ -669,7 +628,7 @@ bool cParse::FetchEvent(xmlNodePtr enode, bool useeptext)
                     xmlFree(content);
                 }
             }
-            else if ((!xmlStrcasecmp(node->name, (const xmlChar *) "country")))
+            else if (element==ELEMENT_COUNTRY)
             {
                 xmlChar *content=xmlNodeListGetString(node->doc,node->xmlChildrenNode,1);
                 if (content)
@@ -678,14 +637,15 @@ bool cParse::FetchEvent(xmlNodePtr enode, bool useeptext)
                     xmlFree(content);
                 }
             }
-            else if ((!xmlStrcasecmp(node->name, (const xmlChar *) "video")))
+            else if (element==ELEMENT_VIDEO)
             {
                 xmlNodePtr vnode=node->xmlChildrenNode;
                 while (vnode)
                 {
                     if (vnode->type==XML_ELEMENT_NODE)
                     {
-                        if ((!xmlStrcasecmp(vnode->name, (const xmlChar *) "colour")))
+                        int velement=ElementType(vnode->name);
+                        if (velement==ELEMENT_COLOUR)
                         {
                             xmlChar *content=xmlNodeListGetString(vnode->doc,vnode->xmlChildrenNode,1);
                             if (content)
@@ -694,7 +654,7 @@ bool cParse::FetchEvent(xmlNodePtr enode, bool useeptext)
                                 xmlFree(content);
                             }
                         }
-                        if ((!xmlStrcasecmp(vnode->name, (const xmlChar *) "aspect")))
+                        else if (velement==ELEMENT_ASPECT)
                         {
                             xmlChar *content=xmlNodeListGetString(vnode->doc,vnode->xmlChildrenNode,1);
                             if (content)
@@ -703,7 +663,7 @@ bool cParse::FetchEvent(xmlNodePtr enode, bool useeptext)
                                 xmlFree(content);
                             }
                         }
-                        if ((!xmlStrcasecmp(vnode->name, (const xmlChar *) "quality")))
+                        else if (velement==ELEMENT_QUALITY)
                         {
                             xmlChar *content=xmlNodeListGetString(vnode->doc,vnode->xmlChildrenNode,1);
                             if (content)
@@ -712,19 +672,18 @@ bool cParse::FetchEvent(xmlNodePtr enode, bool useeptext)
                                 xmlFree(content);
                             }
                         }
-
                     }
                     vnode=vnode->next;
                 }
             }
-            else if ((!xmlStrcasecmp(node->name, (const xmlChar *) "audio")))
+            else if (element==ELEMENT_AUDIO)
             {
                 xmlNodePtr vnode=node->xmlChildrenNode;
                 while (vnode)
                 {
                     if (vnode->type==XML_ELEMENT_NODE)
                     {
-                        if ((!xmlStrcasecmp(vnode->name, (const xmlChar *) "stereo")))
+                        if (ElementType(vnode->name)==ELEMENT_STEREO)
                         {
                             xmlChar *content=xmlNodeListGetString(vnode->doc,vnode->xmlChildrenNode,1);
                             if (content)
@@ -738,7 +697,7 @@ bool cParse::FetchEvent(xmlNodePtr enode, bool useeptext)
                     vnode=vnode->next;
                 }
             }
-            else if ((!xmlStrcasecmp(node->name, (const xmlChar *) "rating")))
+            else if (element==ELEMENT_RATING)
             {
                 xmlChar *system=xmlGetProp(node,(const xmlChar *) "system");
                 if (system)
@@ -748,7 +707,7 @@ bool cParse::FetchEvent(xmlNodePtr enode, bool useeptext)
                     {
                         if (vnode->type==XML_ELEMENT_NODE)
                         {
-                            if ((!xmlStrcasecmp(vnode->name, (const xmlChar *) "value")))
+                            if (ElementType(vnode->name)==ELEMENT_VALUE)
                             {
                                 xmlChar *content=xmlNodeListGetString(vnode->doc,vnode->xmlChildrenNode,1);
                                 if (content)
@@ -763,7 +722,7 @@ bool cParse::FetchEvent(xmlNodePtr enode, bool useeptext)
                     xmlFree(system);
                 }
             }
-            else if ((!xmlStrcasecmp(node->name, (const xmlChar *) "star-rating")))
+            else if (element==ELEMENT_STARRATING)
             {
                 xmlChar *system=xmlGetProp(node,(const xmlChar *) "system");
                 xmlNodePtr vnode=node->xmlChildrenNode;
@@ -771,7 +730,7 @@ bool cParse::FetchEvent(xmlNodePtr enode, bool useeptext)
                 {
                     if (vnode->type==XML_ELEMENT_NODE)
                     {
-                        if ((!xmlStrcasecmp(vnode->name, (const xmlChar *) "value")))
+                        if (ElementType(vnode->name)==ELEMENT_VALUE)
                         {
                             xmlChar *content=xmlNodeListGetString(vnode->doc,vnode->xmlChildrenNode,1);
                             if (content)
@@ -785,7 +744,7 @@ bool cParse::FetchEvent(xmlNodePtr enode, bool useeptext)
                 }
                 if (system) xmlFree(system);
             }
-            else if ((!xmlStrcasecmp(node->name, (const xmlChar *) "review")))
+            else if (element==ELEMENT_REVIEW)
             {
                 xmlChar *type=xmlGetProp(node,(const xmlChar *) "type");
                 if (type && !xmlStrcasecmp(type, (const xmlChar *) "text"))
@@ -799,7 +758,7 @@ bool cParse::FetchEvent(xmlNodePtr enode, bool useeptext)
                     xmlFree(type);
                 }
             }
-            else if ((!xmlStrcasecmp(node->name, (const xmlChar *) "icon")))
+            else if (element==ELEMENT_ICON)
             {
                 xmlChar *src=xmlGetProp(node,(const xmlChar *) "src");
                 if (src)
@@ -815,8 +774,8 @@ bool cParse::FetchEvent(xmlNodePtr enode, bool useeptext)
                         // just try it
                         f=src;
                     }
-                    struct stat statbuf;
-                    if (stat((const char *) f,&statbuf)!=-1)
+                    cParse *parse=master ? master : this;
+                    if (parse->pics.Exists((const char *) f))
                     {
                         char *file=strrchr((char *) f,'/');
                         if (file)
@@ -829,7 +788,7 @@ bool cParse::FetchEvent(xmlNodePtr enode, bool useeptext)
                 }
 
             }
-            else if ((!xmlStrcasecmp(node->name, (const xmlChar *) "episode-num")))
+            else if (element==ELEMENT_EPISODENUM)
             {
                 xmlChar *system=xmlGetProp(node,(const xmlChar *) "system");
                 if (system && !xmlStrcasecmp(system,(const xmlChar *) "xmltv_ns"))
@@ -879,33 +838,14 @@ bool cParse::FetchEvent(xmlNodePtr enode, bool useeptext)
                 }
                 if (system) xmlFree(system);
             }
-            else if ((!xmlStrcasecmp(node->name, (const xmlChar *) "length")))
-            {
-                // length without advertisements -> just ignore
-            }
-            else if ((!xmlStrcasecmp(node->name, (const xmlChar *) "subtitles")))
-            {
-                // info about subtitles -> just ignore (till now)
-            }
-            else if ((!xmlStrcasecmp(node->name, (const xmlChar *) "new")))
-            {
-                // info if it's new -> just ignore (till now)
-            }
-            else if ((!xmlStrcasecmp(node->name, (const xmlChar *) "premiere")))
+            else if (element==ELEMENT_IGNORE)
             {
-                // premiere info -> just ignore (till now)
-            }
-            else if ((!xmlStrcasecmp(node->name, (const xmlChar *) "previously-shown")))
-            {
-                // info if it's old ;) -> just ignore (till now)
-            }
-            else if ((!xmlStrcasecmp(node->name, (const xmlChar *) "live")))
-            {
-                // live -> just ignore (till now)
+                // length, subtitles, new, premiere, previously-shown
+                // and live -> just ignore (till now)
             }
             else
             {
-                esyslogs(source,"unknown element %s, please report!",node->name);
+                UnknownElement(node->name);
             }
         }
         node=node->next;
@@ -936,244 +876,557 @@ bool cParse::FetchEvent(xmlNodePtr enode, bool useeptext)
     return xevent.HasTitle();
 }
 
-int cParse::Process(cEPGExecutor &myExecutor,char *buffer, int bufsize)
+void cParse::PrepareJob(cParseJob *Job)
 {
-    if (!buffer) return 134;
-    if (!bufsize) return 134;
+    xevent.Clear();
+    xevent.SetStartTime(Job->starttime);
+    if (Job->duration) xevent.SetDuration(Job->duration);
 
-    dsyslogs(source,"parsing output");
+    Job->fetched=FetchEvent(Job->node,(Job->map->Flags() & OPT_SEASON_STEXTITLE)==OPT_SEASON_STEXTITLE); // sets xevent
+    if (!Job->fetched) return;
 
-    xmlDocPtr xmltv;
-    xmltv=xmlReadMemory(buffer,bufsize,NULL,NULL,0);
-    if (!xmltv)
+    if (!xevent.EventID())
     {
-        esyslogs(source,"failed to parse xmltv");
-        return 141;
+        Job->weak=true;
+        xevent.CreateEventID(xevent.StartTime());
+        if (xevent.Title()) Job->title=strdup(xevent.Title());
     }
+    Job->eventid=xevent.EventID();
+    Job->hash=xevent.Hash(source->Index());
+
+    // the values are the same for all channels of the mapping, the
+    // keys are set by StoreJob, workers don't know the source key
+    xevent.GetSQLValues(srcid,source->Index(),&Job->values);
+    Job->channels=Job->map->NumChannelIDs();
+}
 
-    xmlNodePtr rootnode=xmlDocGetRootElement(xmltv);
-    if (!rootnode)
+bool cParse::channelkeys(sqlite3 *Db, cEPGMapping *Map)
+{
+    chidmap=NULL;
+    chids.Clear();
+    for (int i=0; i<Map->NumChannelIDs(); i++)
     {
-        esyslogs(source,"no rootnode in xmltv");
-        xmlFreeDoc(xmltv);
-        return 141;
+        sqlite3_int64 chid=cXMLTVEvent::ChannelKey(Db,Map->ChannelIDs()[i].ToString());
+        if (chid<0) return false;
+        chids.Append(chid);
     }
+    chidmap=Map;
+    return true;
+}
 
-    sqlite3 *db=NULL;
-    if (sqlite3_open(g->EPGFile(),&db)!=SQLITE_OK)
+void cParse::StoreJob(sqlite3 *Db, cParseJob *Job, int &lerr, int &lweak, int &skipped)
+{
+    if (!Job->fetched)
     {
-        esyslogs(source,"failed to open or create %s",g->EPGFile());
-        xmlFreeDoc(xmltv);
-        return 141;
+        if (lerr!=PARSE_FETCHERR)
+            esyslogs(source,"failed to fetch event");
+        lerr=PARSE_FETCHERR;
+        skipped++;
+        return;
     }
 
-    char sql[]="CREATE TABLE IF NOT EXISTS epg (" \
-               "src nvarchar(100), channelid nvarchar(255), eventid int, eiteventid int, "\
-               "starttime datetime, duration int, title nvarchar(255), alttitle nvarchar(255), "\
-               "origtitle nvarchar(255), shorttext nvarchar(255), description text, "\
-               "eitdescription text, country nvarchar(255), year int, " \
-               "credits text, category text, review text, rating text, " \
-               "starrating text, video text, audio text, season int, episode int, " \
-               "episodeoverall int, pics text, srcidx int," \
-               "PRIMARY KEY(eventid, src, channelid)" \
-               ");" \
-               "CREATE INDEX IF NOT EXISTS idx1 on epg (starttime, eiteventid, channelid); " \
-               "CREATE INDEX IF NOT EXISTS idx2 on epg (starttime, title, channelid); " \
-               "CREATE INDEX IF NOT EXISTS idx3 on epg (starttime, duration, src); " \
-               "BEGIN";
-
-    char *errmsg;
-    if (sqlite3_exec(db,sql,NULL,NULL,&errmsg)!=SQLITE_OK)
+    if (Job->weak)
     {
-        esyslogs(source,"createdb: %s",errmsg);
-        sqlite3_free(errmsg);
-        sqlite3_close(db);
-        xmlFreeDoc(xmltv);
-        return 141;
+        if (lweak!=PARSE_NOEVENTID)
+            isyslogs(source,"event without id, using starttime as id (weak)!");
+        lweak=PARSE_NOEVENTID;
     }
 
-    time_t begin=time(NULL)-7200;
-    xmlNodePtr node=rootnode->xmlChildrenNode;
+    if ((Job->map!=chidmap) && (!channelkeys(Db,Job->map)))
+    {
+        if (lerr!=PARSE_SQLERR)
+            esyslogs(source,"sqlite3: %s (channels)",sqlite3_errmsg(Db));
+        lerr=PARSE_SQLERR;
+        skipped++;
+        return;
+    }
 
-    int lerr=0,lweak=0;
-    xmlChar *lastchannelid=NULL;
-    int skipped=0;
-    bool do_unlink=false;
-    while (node)
+    Job->values.SetNumber(XMLTVPARAM_SRCID,srcid);
+    for (int i=0; i<Job->channels; i++)
     {
-        if (node->type!=XML_ELEMENT_NODE)
+        if (i>=chids.Size()) break;
+        // compare with the fingerprint of the stored row first
+        bool exists=false;
+        if (hashstmt)
         {
-            node=node->next;
-            continue;
+            sqlite3_bind_int64(hashstmt,1,srcid);
+            sqlite3_bind_int64(hashstmt,2,chids[i]);
+            sqlite3_bind_int64(hashstmt,3,Job->eventid);
+            if (sqlite3_step(hashstmt)==SQLITE_ROW)
+            {
+                exists=true;
+                if ((sqlite3_column_type(hashstmt,0)==SQLITE_INTEGER) &&
+                        ((uint64_t) sqlite3_column_int64(hashstmt,0)==Job->hash))
+                {
+                    sqlite3_reset(hashstmt);
+                    unchanged++;
+                    continue;
+                }
+            }
+            sqlite3_reset(hashstmt);
         }
-        if ((xmlStrcasecmp(node->name, (const xmlChar *) "programme")))
+        Job->values.SetNumber(XMLTVPARAM_CHID,chids[i]);
+        bool update_issued=false;
+        int ret=SQLITE_CONSTRAINT;
+        if (upsertstmt)
         {
-            node=node->next;
-            continue;
+            // the fingerprint lookup tells an update from an insert
+            ret=Job->values.Bind(upsertstmt);
+            if (ret==SQLITE_OK) ret=sqlite3_step(upsertstmt);
+            sqlite3_reset(upsertstmt);
+            update_issued=exists;
         }
-        xmlChar *channelid=xmlGetProp(node,(const xmlChar *) "channel");
-        if (!channelid)
+        else if (!exists)
         {
-            if (lerr!=PARSE_NOCHANNELID)
-                esyslogs(source,"missing channelid in xmltv file");
-            lerr=PARSE_NOCHANNELID;
-            node=node->next;
-            skipped++;
-            continue;
+            ret=Job->values.Bind(insertstmt);
+            if (ret==SQLITE_OK) ret=sqlite3_step(insertstmt);
+            sqlite3_reset(insertstmt);
         }
-        cEPGMapping *map=g->EPGMappings()->GetMap((const char *) channelid);
-        if (!map)
+        if (ret==SQLITE_CONSTRAINT)
         {
-            if ((lerr!=PARSE_NOMAPPING) || (lastchannelid && xmlStrcmp(channelid,lastchannelid)))
-                esyslogs(source,"no mapping for channelid %s",channelid);
-            lerr=PARSE_NOMAPPING;
-            if (lastchannelid) xmlFree(lastchannelid);
-            lastchannelid=xmlStrdup(channelid);
-            xmlFree(channelid);
-            node=node->next;
-            skipped++;
-            continue;
+            ret=Job->values.Bind(updatestmt);
+            if (ret==SQLITE_OK) ret=sqlite3_step(updatestmt);
+            sqlite3_reset(updatestmt);
+            update_issued=true;
         }
-        if (lastchannelid) xmlFree(lastchannelid);
-        lastchannelid=xmlStrdup(channelid);
-        xmlFree(channelid);
-
-        xmlChar *start=NULL,*stop=NULL;
-        time_t starttime=(time_t) 0;
-        time_t stoptime=(time_t) 0;
-        start=xmlGetProp(node,(const xmlChar *) "start");
-        if (start)
+        if (ret!=SQLITE_DONE)
         {
-            starttime=ConvertXMLTVTime2UnixTime((char *) start);
-            if (starttime)
+            if (lerr!=PARSE_SQLERR)
             {
-                stop=xmlGetProp(node,(const xmlChar *) "stop");
-                if (stop)
+                if (!Job->weak)
+                {
+                    esyslogs(source,"sqlite3: %s (%u@%i)",sqlite3_errmsg(Db),Job->eventid,Job->line);
+                }
+                else
                 {
-                    stoptime=ConvertXMLTVTime2UnixTime((char *) stop);
+                    esyslogs(source,"sqlite3: %s ('%s'@%i)",sqlite3_errmsg(Db),Job->title,Job->line);
                 }
+                if (upsertstmt)
+                    tsyslogs(source,"sqlite3: %s",cXMLTVEvent::UpsertSQL());
+                else
+                    tsyslogs(source,"sqlite3: %s",update_issued ? cXMLTVEvent::UpdateSQL() :
+                             cXMLTVEvent::InsertSQL());
             }
-        }
-
-        if (!starttime)
-        {
-            if (lerr!=PARSE_XMLTVERR)
-                esyslogs(source,"no starttime, check xmltv file");
-            lerr=PARSE_XMLTVERR;
-            node=node->next;
+            lerr=PARSE_SQLERR;
             skipped++;
-            if (start) xmlFree(start);
-            if (stop) xmlFree(stop);
-            continue;
+            break;
         }
+        if (update_issued)
+            updated++;
+        else
+            inserted++;
+    }
+    if ((bulkrows) && (inserted>bulkrows)) bulkload(Db);
+}
 
-        if (starttime<begin)
-        {
-            node=node->next;
-            if (start) xmlFree(start);
-            if (stop) xmlFree(stop);
-            continue;
-        }
-        xevent.Clear();
-        xevent.SetStartTime(starttime);
-        if (stoptime)
+void cParse::bulkload(sqlite3 *Db)
+{
+    // from now on the secondary indexes are built once before the
+    // commit, that also repairs a partial drop
+    bulkrows=0;
+    bulk=true;
+    if (!g->DropDBIndexes(Db))
+    {
+        esyslogs(source,"sqlite3: %s (bulk load)",sqlite3_errmsg(Db));
+        return;
+    }
+    dsyslogs(source,"bulk loading after %i new events",inserted);
+}
+
+static void expandentities(xmlDocPtr Doc, xmlNodePtr List)
+{
+    for (xmlNodePtr node=List; node; )
+    {
+        xmlNodePtr next=node->next;
+        if (node->type==XML_ENTITY_REF_NODE)
         {
-            if (stoptime<starttime)
+            // resolved through the document, as xmlNodeListGetString does
+            node->doc=Doc;
+            xmlChar *content=xmlNodeGetContent(node);
+            node->doc=NULL;
+            xmlNodePtr text=xmlNewText(content ? content : (const xmlChar *) "");
+            if (content) xmlFree(content);
+            if (text)
             {
-                if (lerr!=PARSE_XMLTVERR)
-                    esyslogs(source,"stoptime (%s) < starttime(%s), check xmltv file", stop, start);
-                lerr=PARSE_XMLTVERR;
-                node=node->next;
-                skipped++;
-                if (start) xmlFree(start);
-                if (stop) xmlFree(stop);
-                continue;
+                xmlReplaceNode(node,text);
+                xmlFreeNode(node);
             }
-            xevent.SetDuration(stoptime-starttime);
         }
-
-        if (start) xmlFree(start);
-        if (stop) xmlFree(stop);
-
-        if (!FetchEvent(node,(map->Flags() & OPT_SEASON_STEXTITLE)==OPT_SEASON_STEXTITLE)) // sets xevent
+        else if (node->type==XML_ELEMENT_NODE)
         {
-            if (lerr!=PARSE_FETCHERR)
-                esyslogs(source,"failed to fetch event");
-            lerr=PARSE_FETCHERR;
-            node=node->next;
-            skipped++;
-            continue;
+            for (xmlAttrPtr attr=node->properties; attr; attr=attr->next)
+                expandentities(Doc,attr->children);
+            expandentities(Doc,node->children);
         }
-        const xmlError* xmlerr=xmlGetLastError();
-        if (xmlerr && xmlerr->code)
+        node=next;
+    }
+}
+
+static xmlNodePtr copynode(xmlNodePtr Node)
+{
+    // the copy for the workers has no document to look up entities,
+    // so the references are replaced by their text
+    xmlNodePtr copy=xmlCopyNode(Node,1);
+    if (copy) expandentities(Node->doc,copy);
+    return copy;
+}
+
+int cParse::Process(cEPGExecutor &myExecutor, xmlInputReadCallback ReadCallback, void *Context)
+{
+    if (!ReadCallback) return 134;
+
+    dsyslogs(source,"parsing output while reading");
+
+    // programmes of unmapped channels are dropped before parsing
+    cParseFilter filter(source,g,ReadCallback,Context);
+    xmlTextReaderPtr reader=xmlReaderForIO(cParseFilter::Read,NULL,&filter,NULL,NULL,0);
+    if (!reader)
+    {
+        esyslogs(source,"failed to parse xmltv");
+        return 141;
+    }
+    return Process(myExecutor,reader,&filter);
+}
+
+int cParse::Process(cEPGExecutor &myExecutor, xmlTextReaderPtr reader, cParseFilter *Filter)
+{
+    zones.Clear();
+    unknownnames.Clear();
+    unknowncounts.Clear();
+    pics.Clear();
+    sqlite3 *db=NULL;
+    if (g->OpenDB(&db,SQLITE_OPEN_READWRITE|SQLITE_OPEN_CREATE)!=SQLITE_OK)
+    {
+        esyslogs(source,"failed to open or create %s",g->EPGFile());
+        xmlFreeTextReader(reader);
+        return 141;
+    }
+
+    // creates the table or brings an older one up to date
+    if (!g->UpgradeDB(db))
+    {
+        esyslogs(source,"failed to create or upgrade %s",g->EPGFile());
+        sqlite3_close(db);
+        xmlFreeTextReader(reader);
+        return 141;
+    }
+
+    char *errmsg;
+    if (sqlite3_exec(db,"BEGIN",NULL,NULL,&errmsg)!=SQLITE_OK)
+    {
+        esyslogs(source,"sqlite3: %s",errmsg);
+        sqlite3_free(errmsg);
+        sqlite3_close(db);
+        xmlFreeTextReader(reader);
+        return 141;
+    }
+
+    inserted=updated=unchanged=0;
+    chidmap=NULL;
+    chids.Clear();
+    srcid=cXMLTVEvent::SourceKey(db,source->Name());
+    if (srcid<0)
+    {
+        esyslogs(source,"sqlite3: %s (sources)",sqlite3_errmsg(db));
+        sqlite3_exec(db,"ROLLBACK",NULL,NULL,NULL);
+        sqlite3_close(db);
+        xmlFreeTextReader(reader);
+        return 141;
+    }
+    // there is nothing to compare with on the first import of a source
+    // (new box or after DELD), big imports then switch to a bulk load
+    bool fresh=false;
+    bulk=false;
+    bulkrows=0;
+    sqlite3_stmt *stmt;
+    if (sqlite3_prepare_v2(db,"SELECT 1 FROM epg WHERE srcid=?1 LIMIT 1",-1,&stmt,NULL)==SQLITE_OK)
+    {
+        sqlite3_bind_int64(stmt,1,srcid);
+        fresh=(sqlite3_step(stmt)==SQLITE_DONE);
+        sqlite3_finalize(stmt);
+    }
+    if ((fresh) && (sqlite3_prepare_v2(db,"SELECT count(*) FROM epg",-1,&stmt,NULL)==SQLITE_OK))
+    {
+        // rebuilding the indexes pays off, when the new rows outnumber
+        // the rows of the other sources
+        if (sqlite3_step(stmt)==SQLITE_ROW)
         {
-            esyslogs(source,"%s",xmlerr->message);
+            sqlite3_int64 rows=sqlite3_column_int64(stmt,0);
+            bulkrows=(rows>PARSEBULKROWS) ? rows : PARSEBULKROWS;
         }
+        sqlite3_finalize(stmt);
+    }
+    if ((fresh) || (sqlite3_prepare_v2(db,"SELECT hash FROM epg WHERE srcid=?1 AND chid=?2 AND eventid=?3",
+                                       -1,&hashstmt,NULL)!=SQLITE_OK)) hashstmt=NULL;
+    // the statements are prepared once and reused for all programmes
+    if ((sqlite3_prepare_v2(db,cXMLTVEvent::InsertSQL(),-1,&insertstmt,NULL)!=SQLITE_OK) ||
+            (sqlite3_prepare_v2(db,cXMLTVEvent::UpdateSQL(),-1,&updatestmt,NULL)!=SQLITE_OK))
+    {
+        esyslogs(source,"sqlite3: %s",sqlite3_errmsg(db));
+        if (hashstmt) sqlite3_finalize(hashstmt);
+        if (insertstmt) sqlite3_finalize(insertstmt);
+        hashstmt=insertstmt=updatestmt=NULL;
+        sqlite3_exec(db,"ROLLBACK",NULL,NULL,NULL);
+        sqlite3_close(db);
+        xmlFreeTextReader(reader);
+        return 141;
+    }
+    // otherwise an existing row needs both statements, the first
+    // import only inserts and updates duplicates of the xmltv. The
+    // upsert relies on the fingerprint lookup to count the updates
+    if ((fresh) || (!hashstmt) || (!cXMLTVEvent::HasUpsert()) ||
+            (sqlite3_prepare_v2(db,cXMLTVEvent::UpsertSQL(),-1,&upsertstmt,NULL)!=SQLITE_OK))
+        upsertstmt=NULL;
+
+    time_t begin=time(NULL)-7200;
 
-        if (!xevent.EventID())
+    // with more than one thread, the programmes are prepared by a pool of
+    // workers and stored in their original order by a single writer thread
+    int threads=g->ParseThreads();
+    if (!threads)
+    {
+        threads=sysconf(_SC_NPROCESSORS_ONLN)-1;
+        if (threads>4) threads=4;
+    }
+    cParseQueue *queue=NULL;
+    cParseWriter *writer=NULL;
+    cVector<cParseWorker *> workers;
+    if (threads>1)
+    {
+        dsyslogs(source,"parsing with %i threads",threads);
+        queue=new cParseQueue();
+        for (int i=0; i<threads; i++)
         {
-            if (lweak!=PARSE_NOEVENTID)
-                isyslogs(source,"event without id, using starttime as id (weak)!");
-            lweak=PARSE_NOEVENTID;
-            xevent.CreateEventID(xevent.StartTime());
+            cParseWorker *worker=new cParseWorker(this,source,g,queue);
+            workers.Append(worker);
+            worker->Start();
         }
+        writer=new cParseWriter(this,queue,db);
+        writer->Start();
+    }
 
-        for (int i=0; i<map->NumChannelIDs(); i++)
+    int lerr=0,lweak=0;
+    xmlChar *lastchannelid=NULL;
+    int skipped=0;
+    bool rootnode=false;
+    bool skipsubtree=false;
+    int ret;
+    // walk the children of the rootnode one by one, only the
+    // current programme is expanded into a (small) subtree
+    while ((ret=(skipsubtree ? xmlTextReaderNext(reader) : xmlTextReaderRead(reader)))==1)
+    {
+        skipsubtree=false;
+        if (xmlTextReaderNodeType(reader)!=XML_READER_TYPE_ELEMENT) continue;
+        if (!xmlTextReaderDepth(reader))
+        {
+            rootnode=true;
+            continue;
+        }
+        skipsubtree=true;
+        if (ElementType(xmlTextReaderConstName(reader))!=ELEMENT_PROGRAMME) continue;
+        xmlNodePtr node=xmlTextReaderExpand(reader);
+        if (!node) continue;
+        xmlChar *channelid=xmlGetProp(node,(const xmlChar *) "channel");
+        if (!channelid)
+        {
+            if (lerr!=PARSE_NOCHANNELID)
+                esyslogs(source,"missing channelid in xmltv file");
+            lerr=PARSE_NOCHANNELID;
+            skipped++;
+            continue;
+        }
+        cEPGMapping *map=g->EPGMappings()->GetMap((const char *) channelid);
+        if (!map)
         {
-            char *isql,*usql;
-            xevent.GetSQL(source->Name(),source->Index(),map->ChannelIDs()[i].ToString(),&isql,&usql);
-            if (isql && usql)
+            if ((lerr!=PARSE_NOMAPPING) || (lastchannelid && xmlStrcmp(channelid,lastchannelid)))
+                esyslogs(source,"no mapping for channelid %s",channelid);
+            lerr=PARSE_NOMAPPING;
+            if (lastchannelid) xmlFree(lastchannelid);
+            lastchannelid=xmlStrdup(channelid);
+            xmlFree(channelid);
+            skipped++;
+            continue;
+        }
+        if (lastchannelid) xmlFree(lastchannelid);
+        lastchannelid=xmlStrdup(channelid);
+        xmlFree(channelid);
+
+        xmlChar *start=NULL,*stop=NULL;
+        time_t starttime=(time_t) 0;
+        time_t stoptime=(time_t) 0;
+        start=xmlGetProp(node,(const xmlChar *) "start");
+        if (start)
+        {
+            starttime=zones.ConvertXMLTVTime2UnixTime((char *) start);
+            if (starttime)
             {
-                int ret=sqlite3_exec(db,isql,NULL,NULL,&errmsg);
-                if (ret!=SQLITE_OK)
+                stop=xmlGetProp(node,(const xmlChar *) "stop");
+                if (stop)
                 {
-                    bool update_issued=false;
-                    if (ret==SQLITE_CONSTRAINT)
-                    {
-                        sqlite3_free(errmsg);
-                        ret=sqlite3_exec(db,usql,NULL,NULL,&errmsg);
-                        update_issued=true;
-                    }
-                    if (ret!=SQLITE_OK)
-                    {
-                        if (lerr!=PARSE_SQLERR)
-                        {
-                            if (strstr(errmsg,"has no column named"))
-                            {
-                                esyslogs(source,"sqlite3: database schema changed, unlinking epg.db!");
-                                do_unlink=true;
-                            }
-                            else
-                            {
-                                if (!xevent.WeakID())
-                                {
-                                    esyslogs(source,"sqlite3: %s (%u@%i)",errmsg,xevent.EventID(),node->line);
-                                    tsyslogs(source,"sqlite3: %s",isql);
-                                    if (update_issued) tsyslogs(source,"sqlite3: %s",usql);
-                                }
-                                else
-                                {
-                                    esyslogs(source,"sqlite3: %s ('%s'@%i)",errmsg,xevent.Title(),node->line);
-                                    tsyslogs(source,"sqlite3: %s",isql);
-                                    if (update_issued) tsyslogs(source,"sqlite3: %s",usql);
-                                }
-                            }
-                        }
-                        lerr=PARSE_SQLERR;
-                        sqlite3_free(errmsg);
-                        skipped++;
-                        break;
-                    }
+                    stoptime=zones.ConvertXMLTVTime2UnixTime((char *) stop);
                 }
             }
         }
-        node=node->next;
+
+        if (!starttime)
+        {
+            if (lerr!=PARSE_XMLTVERR)
+                esyslogs(source,"no starttime, check xmltv file");
+            lerr=PARSE_XMLTVERR;
+            skipped++;
+            if (start) xmlFree(start);
+            if (stop) xmlFree(stop);
+            continue;
+        }
+
+        if (starttime<begin)
+        {
+            if (start) xmlFree(start);
+            if (stop) xmlFree(stop);
+            continue;
+        }
+        if ((stoptime) && (stoptime<starttime))
+        {
+            if (lerr!=PARSE_XMLTVERR)
+                esyslogs(source,"stoptime (%s) < starttime(%s), check xmltv file", stop, start);
+            lerr=PARSE_XMLTVERR;
+            skipped++;
+            if (start) xmlFree(start);
+            if (stop) xmlFree(stop);
+            continue;
+        }
+
+        if (start) xmlFree(start);
+        if (stop) xmlFree(stop);
+
+        const xmlError* xmlerr=xmlGetLastError();
+        if (xmlerr && xmlerr->code)
+        {
+            esyslogs(source,"%s",xmlerr->message);
+        }
+
+        if (queue)
+        {
+            cParseJob *job=new cParseJob();
+            job->node=copynode(node);
+            job->ownnode=true;
+            job->map=map;
+            job->starttime=starttime;
+            if (stoptime) job->duration=stoptime-starttime;
+            job->line=node->line;
+            if ((!job->node) || (!queue->Put(job)))
+            {
+                delete job;
+                break;
+            }
+        }
+        else
+        {
+            cParseJob job;
+            job.node=node;
+            job.map=map;
+            job.starttime=starttime;
+            if (stoptime) job.duration=stoptime-starttime;
+            job.line=node->line;
+            PrepareJob(&job);
+            StoreJob(db,&job,lerr,lweak,skipped);
+        }
         if (!myExecutor.StillRunning())
         {
             isyslogs(source,"request to stop from vdr");
+            if (queue) queue->Abort();
             break;
         }
-        if (do_unlink) break;
+    }
+
+    int werr=0;
+    if (queue)
+    {
+        if (ret==-1)
+            queue->Abort();
+        else
+            queue->Finish();
+        while (writer->Active())
+        {
+            if (!myExecutor.StillRunning()) queue->Abort();
+            cCondWait::SleepMs(10);
+        }
+        for (int i=0; i<workers.Size(); i++)
+        {
+            while (workers[i]->Active()) cCondWait::SleepMs(10);
+            delete workers[i];
+        }
+        werr=writer->lerr;
+        skipped+=writer->skipped;
+        delete writer;
+        delete queue;
+    }
+
+    if (hashstmt)
+    {
+        sqlite3_finalize(hashstmt);
+        hashstmt=NULL;
+    }
+    sqlite3_finalize(insertstmt);
+    sqlite3_finalize(updatestmt);
+    sqlite3_finalize(upsertstmt);
+    insertstmt=updatestmt=upsertstmt=NULL;
+
+    if (Filter)
+    {
+        skipped+=Filter->Skipped();
+        if ((Filter->Skipped()) && (!lerr)) lerr=PARSE_NOMAPPING;
+    }
+
+    if (lastchannelid) xmlFree(lastchannelid);
+    for (int i=0; i<unknownnames.Size(); i++)
+    {
+        if (unknowncounts[i]>1)
+            isyslogs(source,"unknown element %s found %i times",unknownnames[i],unknowncounts[i]);
+    }
+    if (pics.Missing())
+        isyslogs(source,"%i pictures missing",pics.Missing());
+    int fuzzyqueries,fuzzyhits;
+    double fuzzytime;
+    if (EPLists.FuzzyStatistics(fuzzyqueries,fuzzyhits,fuzzytime))
+        isyslogs(source,"fuzzy eplists search found %i of %i shorttexts (%i%%, %.1f us average)",
+                 fuzzyhits,fuzzyqueries,(100*fuzzyhits)/fuzzyqueries,fuzzytime);
+    xmlFreeTextReader(reader);
+
+    bool readerr=false;
+    if ((!ret) && (Filter))
+    {
+        // wait for the end of the input, the import is
+        // only committed if reading ends without error
+        char tmp[4096];
+        int l;
+        while ((l=cParseFilter::Read(Filter,tmp,sizeof(tmp)))>0);
+        if (l<0) readerr=true;
+    }
+
+    if ((ret==-1) || (readerr) || (!rootnode))
+    {
+        if (ret==-1)
+            esyslogs(source,"failed to parse xmltv");
+        else if (readerr)
+            esyslogs(source,"failed to read xmltv");
+        else
+            esyslogs(source,"no rootnode in xmltv");
+        if (sqlite3_exec(db,"ROLLBACK",NULL,NULL,&errmsg)!=SQLITE_OK)
+        {
+            esyslogs(source,"sqlite3: ROLLBACK %s",errmsg);
+            sqlite3_free(errmsg);
+        }
+        sqlite3_close(db);
+        return 141;
+    }
+
+    if ((bulk) && (!g->CreateDBIndexes(db)))
+    {
+        esyslogs(source,"sqlite3: %s (indexes)",sqlite3_errmsg(db));
+        sqlite3_exec(db,"ROLLBACK",NULL,NULL,NULL);
+        sqlite3_close(db);
+        return 141;
     }
 
     if (sqlite3_exec(db,"COMMIT",NULL,NULL,&errmsg)!=SQLITE_OK)
@@ -1182,18 +1435,20 @@ int cParse::Process(cEPGExecutor &myExecutor,char *buffer, int bufsize)
         sqlite3_free(errmsg);
     }
 
-    int cnt=sqlite3_total_changes(db);
+    int cnt=inserted+updated+unchanged;
 
-    if ((skipped) && (!do_unlink))
+    if (skipped)
         isyslogs(source,"skipped %i xmltv events",skipped);
 
-    if (!lerr)
+    if ((!lerr) && (!werr))
     {
-        isyslogs(source,"processed %i xmltv events",cnt);
+        isyslogs(source,"processed %i xmltv events (%i new, %i updated, %i unchanged)",
+                 cnt,inserted,updated,unchanged);
     }
     else
     {
-        isyslogs(source,"processed %i xmltv events - see ERRORs above!",cnt);
+        isyslogs(source,"processed %i xmltv events (%i new, %i updated, %i unchanged) - see ERRORs above!",
+                 cnt,inserted,updated,unchanged);
     }
 
     if (sqlite3_exec(db,"ANALYZE epg;",NULL,NULL,&errmsg)!=SQLITE_OK)
@@ -1204,10 +1459,6 @@ int cParse::Process(cEPGExecutor &myExecutor,char *buffer, int bufsize)
 
     sqlite3_close(db);
 
-    xmlFreeDoc(xmltv);
-
-    if (do_unlink) unlink(g->EPGFile());
-
     return 0;
 }
 
@@ -1221,10 +1472,21 @@ void cParse::CleanupLibXML()
     xmlCleanupParser();
 }
 
-cParse::cParse(cEPGSource *Source, cGlobals *Global)
+cParse::cParse(cEPGSource *Source, cGlobals *Global, cParse *Master)
 {
     source=Source;
     g=Global;
+    master=Master;
+    memset(elements,0,sizeof(elements));
+    hashstmt=NULL;
+    insertstmt=NULL;
+    updatestmt=NULL;
+    upsertstmt=NULL;
+    srcid=-1;
+    bulk=false;
+    bulkrows=0;
+    chidmap=NULL;
+    inserted=updated=unchanged=0;
     if (g->EPDir())
     {
         cep2ascii=iconv_open("ASCII//TRANSLIT",g->EPCodeset());
@@ -1239,6 +1501,628 @@ cParse::cParse(cEPGSource *Source, cGlobals *Global)
 
 cParse::~cParse()
 {
+    for (int i=0; i<ELEMENTCACHESIZE; i++)
+    {
+        if (elements[i].name) xmlFree((void *) elements[i].name);
+    }
     if (cep2ascii!=(iconv_t) -1) iconv_close(cep2ascii);
     if (cutf2ascii!=(iconv_t) -1) iconv_close(cutf2ascii);
 }
+
+// -------------------------------------------------------
+
+cParseJob::cParseJob()
+{
+    node=NULL;
+    ownnode=false;
+    map=NULL;
+    starttime=(time_t) 0;
+    duration=0;
+    line=0;
+    done=false;
+    fetched=false;
+    weak=false;
+    eventid=0;
+    title=NULL;
+    hash=0;
+    channels=0;
+}
+
+cParseJob::~cParseJob()
+{
+    if ((ownnode) && (node)) xmlFreeNode(node);
+    if (title) free(title);
+}
+
+// -------------------------------------------------------
+
+cParseQueue::cParseQueue()
+{
+    memset(jobs,0,sizeof(jobs));
+    produced=dispatched=written=0;
+    finished=false;
+    aborted=false;
+}
+
+cParseQueue::~cParseQueue()
+{
+    for (int i=0; i<PARSEQUEUESIZE; i++)
+    {
+        if (jobs[i]) delete jobs[i];
+    }
+}
+
+bool cParseQueue::Put(cParseJob *Job)
+{
+    cMutexLock lock(&mutex);
+    while ((!aborted) && (produced-written>=PARSEQUEUESIZE)) changed.Wait(mutex);
+    if (aborted) return false;
+    jobs[produced % PARSEQUEUESIZE]=Job;
+    produced++;
+    changed.Broadcast();
+    return true;
+}
+
+cParseJob *cParseQueue::Get()
+{
+    // called by the workers, returns the next job to prepare
+    cMutexLock lock(&mutex);
+    while ((!aborted) && (!finished) && (dispatched==produced)) changed.Wait(mutex);
+    if ((aborted) || (dispatched==produced)) return NULL;
+    cParseJob *job=jobs[dispatched % PARSEQUEUESIZE];
+    dispatched++;
+    return job;
+}
+
+void cParseQueue::Done(cParseJob *Job)
+{
+    cMutexLock lock(&mutex);
+    Job->done=true;
+    changed.Broadcast();
+}
+
+cParseJob *cParseQueue::Next()
+{
+    // called by the writer, returns the prepared jobs in the original order
+    cMutexLock lock(&mutex);
+    for (;;)
+    {
+        if (aborted) return NULL;
+        if (written==produced)
+        {
+            if (finished) return NULL;
+        }
+        else if (jobs[written % PARSEQUEUESIZE]->done)
+        {
+            break;
+        }
+        changed.Wait(mutex);
+    }
+    cParseJob *job=jobs[written % PARSEQUEUESIZE];
+    jobs[written % PARSEQUEUESIZE]=NULL;
+    written++;
+    changed.Broadcast();
+    return job;
+}
+
+void cParseQueue::Finish()
+{
+    cMutexLock lock(&mutex);
+    finished=true;
+    changed.Broadcast();
+}
+
+void cParseQueue::Abort()
+{
+    cMutexLock lock(&mutex);
+    aborted=true;
+    changed.Broadcast();
+}
+
+bool cParseQueue::Aborted()
+{
+    cMutexLock lock(&mutex);
+    return aborted;
+}
+
+// -------------------------------------------------------
+
+cParsePics::cParsePics()
+{
+    names=NULL;
+    size=0;
+    count=0;
+    missing=0;
+}
+
+cParsePics::~cParsePics()
+{
+    Clear();
+}
+
+void cParsePics::Clear()
+{
+    cMutexLock lock(&mutex);
+    for (int i=0; i<size; i++)
+    {
+        if (names[i]) free(names[i]);
+    }
+    free(names);
+    names=NULL;
+    size=count=missing=0;
+    dirs.Clear();
+    statdirs.Clear();
+}
+
+unsigned int cParsePics::hash(const char *Name)
+{
+    // FNV-1a
+    unsigned int h=2166136261U;
+    while (*Name)
+    {
+        h^=(unsigned char) *Name++;
+        h*=16777619U;
+    }
+    return h;
+}
+
+bool cParsePics::contains(const char *Name)
+{
+    if (!size) return false;
+    for (unsigned int i=hash(Name) & (size-1); names[i]; i=(i+1) & (size-1))
+    {
+        if (!strcmp(names[i],Name)) return true;
+    }
+    return false;
+}
+
+void cParsePics::insert(char *Name)
+{
+    if (count*2>=size)
+    {
+        int nsize=size ? size*2 : 1024;
+        char **nnames=(char **) calloc(nsize,sizeof(char *));
+        if (!nnames)
+        {
+            free(Name);
+            return;
+        }
+        for (int i=0; i<size; i++)
+        {
+            if (!names[i]) continue;
+            unsigned int x=hash(names[i]) & (nsize-1);
+            while (nnames[x]) x=(x+1) & (nsize-1);
+            nnames[x]=names[i];
+        }
+        free(names);
+        names=nnames;
+        size=nsize;
+    }
+    unsigned int x=hash(Name) & (size-1);
+    while (names[x]) x=(x+1) & (size-1);
+    names[x]=Name;
+    count++;
+}
+
+char *cParsePics::normalize(const char *Path)
+{
+    // "//" and "/./" name the same directory as "/", so all
+    // spellings of a path end up with the same key
+    char *norm=strdup(Path);
+    if (!norm) return NULL;
+    char *d=norm;
+    for (const char *s=Path; *s; )
+    {
+        if ((s==Path) || (s[-1]=='/'))
+        {
+            if ((s!=Path) && (*s=='/'))
+            {
+                s++;
+                continue;
+            }
+            if ((s[0]=='.') && (s[1]=='/'))
+            {
+                s+=2;
+                continue;
+            }
+        }
+        *d++=*s++;
+    }
+    *d=0;
+    return norm;
+}
+
+void cParsePics::scan(const char *Dir)
+{
+    // read the whole directory once, Dir includes the trailing slash
+    // or is empty for the current directory
+    dirs.Append(strdup(Dir));
+    DIR *dir=opendir(*Dir ? Dir : ".");
+    if (!dir)
+    {
+        // not readable, but maybe searchable
+        if (errno!=ENOENT) statdirs.Append(strdup(Dir));
+        return;
+    }
+    struct dirent *dirent;
+    while ((dirent=readdir(dir)))
+    {
+        if ((!strcmp(dirent->d_name,".")) || (!strcmp(dirent->d_name,".."))) continue;
+        char *name=NULL;
+        if (asprintf(&name,"%s%s",Dir,dirent->d_name)==-1) break;
+        if ((dirent->d_type==DT_LNK) || (dirent->d_type==DT_UNKNOWN))
+        {
+            // skip dangling links like stat() would
+            struct stat statbuf;
+            if (stat(name,&statbuf)==-1)
+            {
+                free(name);
+                continue;
+            }
+        }
+        insert(name);
+    }
+    closedir(dir);
+}
+
+bool cParsePics::Exists(const char *Path)
+{
+    char *path=normalize(Path);
+    if (!path) return false;
+    const char *file=strrchr(path,'/');
+    char *dir=file ? strndup(path,file-path+1) : strdup("");
+    if (!dir)
+    {
+        free(path);
+        return false;
+    }
+    cMutexLock lock(&mutex);
+    bool ret;
+    if (dirs.Find(dir)<0) scan(dir);
+    if (statdirs.Find(dir)>=0)
+    {
+        struct stat statbuf;
+        ret=(stat(path,&statbuf)!=-1);
+    }
+    else
+    {
+        ret=contains(path);
+    }
+    free(dir);
+    free(path);
+    if (!ret) missing++;
+    return ret;
+}
+
+// -------------------------------------------------------
+
+cParseFilter::cParseFilter(cEPGSource *Source, cGlobals *Global, xmlInputReadCallback ReadCallback, void *Context)
+{
+    source=Source;
+    g=Global;
+    readcallback=ReadCallback;
+    context=Context;
+    ibuf=(char *) malloc(PARSEFILTERBUFSIZE);
+    ilen=ipos=0;
+    inputeof=false;
+    tag=(char *) malloc(PARSEFILTERMAXTAG);
+    taglen=tagpos=0;
+    quote=0;
+    state=FILTER_SCAN;
+    matched=0;
+    lastid=NULL;
+    lastmapped=true;
+    skipped=0;
+}
+
+cParseFilter::~cParseFilter()
+{
+    if (ibuf) free(ibuf);
+    if (tag) free(tag);
+    if (lastid) free(lastid);
+}
+
+bool cParseFilter::match(const char *Marker, char c)
+{
+    // advance the number of matched characters of Marker, returns
+    // true if the whole Marker has been found
+    int m;
+    for (m=matched+1; m>0; m--)
+    {
+        if ((Marker[m-1]==c) && (!memcmp(Marker,Marker+matched-m+1,m-1))) break;
+    }
+    matched=m;
+    if (Marker[matched]) return false;
+    matched=0;
+    return true;
+}
+
+bool cParseFilter::mapped()
+{
+    // look for the channel attribute in the collected start tag, if
+    // anything is unusual the programme is passed to libxml
+    const char *p=tag+10;
+    const char *end=tag+taglen-1;
+    const char *value=NULL;
+    int vlen=0;
+    while (p<end)
+    {
+        while ((p<end) && (isspace(*p))) p++;
+        const char *name=p;
+        while ((p<end) && (*p!='=') && (!isspace(*p)) && (*p!='/')) p++;
+        int nlen=p-name;
+        if (!nlen) break;
+        while ((p<end) && (isspace(*p))) p++;
+        if ((p>=end) || (*p!='=')) return true;
+        p++;
+        while ((p<end) && (isspace(*p))) p++;
+        if ((p>=end) || ((*p!='"') && (*p!='\''))) return true;
+        const char *v=p+1;
+        const char *q=(const char *) memchr(v,*p,end-v);
+        if (!q) return true;
+        p=q+1;
+        if ((nlen==7) && (!memcmp(name,"channel",7)))
+        {
+            value=v;
+            vlen=q-v;
+            break;
+        }
+    }
+    if ((!value) || (!vlen)) return true;
+    for (int i=0; i<vlen; i++)
+    {
+        if ((value[i]=='&') || (value[i]=='<') || ((value[i]!=' ') && (isspace(value[i])))) return true;
+    }
+
+    // programmes are usually grouped by channel
+    if ((lastid) && ((int) strlen(lastid)==vlen) && (!memcmp(lastid,value,vlen))) return lastmapped;
+    if (lastid) free(lastid);
+    lastid=strndup(value,vlen);
+    if (!lastid) return true;
+    lastmapped=(g->EPGMappings()->GetMap(lastid)!=NULL);
+    if (!lastmapped) esyslogs(source,"no mapping for channelid %s",lastid);
+    return lastmapped;
+}
+
+bool cParseFilter::flush()
+{
+    // called with a complete programme start tag
+    if (mapped())
+    {
+        state=FILTER_SCAN;
+        return true;
+    }
+    skipped++;
+    bool empty=((taglen>=2) && (tag[taglen-2]=='/'));
+    taglen=tagpos=0;
+    matched=0;
+    state=empty ? FILTER_SCAN : FILTER_SKIP;
+    return false;
+}
+
+int cParseFilter::Read(void *Context, char *Buffer, int Len)
+{
+    // xmlInputReadCallback, drops programmes of unmapped channels
+    // before they reach libxml
+    cParseFilter *f=(cParseFilter *) Context;
+    if ((!f) || (!f->ibuf) || (!f->tag)) return -1;
+    int out=0;
+    while (out<Len)
+    {
+        if ((f->tagpos<f->taglen) && (f->state!=FILTER_PREFIX) && (f->state!=FILTER_TAG))
+        {
+            int n=f->taglen-f->tagpos;
+            if (n>Len-out) n=Len-out;
+            memcpy(Buffer+out,f->tag+f->tagpos,n);
+            out+=n;
+            f->tagpos+=n;
+            if (f->tagpos==f->taglen) f->taglen=f->tagpos=0;
+            continue;
+        }
+        if (f->ipos>=f->ilen)
+        {
+            // don't wait for more input if there is something to return
+            if ((out) || (f->inputeof)) break;
+            int n=f->readcallback(f->context,f->ibuf,PARSEFILTERBUFSIZE);
+            if (n<0) return -1;
+            if (!n)
+            {
+                f->inputeof=true;
+                if ((f->state==FILTER_PREFIX) || (f->state==FILTER_TAG)) f->state=FILTER_SCAN;
+                continue;
+            }
+            f->ilen=n;
+            f->ipos=0;
+        }
+        char *p=f->ibuf+f->ipos;
+        int avail=f->ilen-f->ipos;
+        switch (f->state)
+        {
+        case FILTER_SCAN:
+        {
+            int n=(avail<Len-out) ? avail : Len-out;
+            char *lt=(char *) memchr(p,'<',n);
+            if (lt) n=lt-p;
+            memcpy(Buffer+out,p,n);
+            out+=n;
+            f->ipos+=n;
+            if (lt)
+            {
+                f->tag[0]='<';
+                f->taglen=1;
+                f->tagpos=0;
+                f->ipos++;
+                f->state=FILTER_PREFIX;
+            }
+            break;
+        }
+        case FILTER_PREFIX:
+        {
+            char c=*p;
+            f->ipos++;
+            f->tag[f->taglen++]=c;
+            int l=f->taglen;
+            if ((l<=10) && (!memcmp(f->tag,"<programme",l))) break;
+            if ((l==11) && (!memcmp(f->tag,"<programme",10)) && ((isspace(c)) || (c=='/') || (c=='>')))
+            {
+                f->quote=0;
+                f->state=FILTER_TAG;
+                if (c=='>') f->flush();
+                break;
+            }
+            if ((l<=4) && (!memcmp(f->tag,"<!--",l)))
+            {
+                if (l==4)
+                {
+                    f->matched=0;
+                    f->state=FILTER_COMMENT;
+                }
+                break;
+            }
+            if ((l<=9) && (!memcmp(f->tag,"<![CDATA[",l)))
+            {
+                if (l==9)
+                {
+                    f->matched=0;
+                    f->state=FILTER_CDATA;
+                }
+                break;
+            }
+            f->state=FILTER_SCAN;
+            break;
+        }
+        case FILTER_TAG:
+        {
+            int i;
+            bool complete=false;
+            for (i=0; (i<avail) && (f->taglen<PARSEFILTERMAXTAG); i++)
+            {
+                char c=p[i];
+                f->tag[f->taglen++]=c;
+                if (f->quote)
+                {
+                    if (c==f->quote) f->quote=0;
+                }
+                else if ((c=='"') || (c=='\''))
+                {
+                    f->quote=c;
+                }
+                else if (c=='>')
+                {
+                    complete=true;
+                    i++;
+                    break;
+                }
+            }
+            f->ipos+=i;
+            if (complete)
+                f->flush();
+            else if (f->taglen>=PARSEFILTERMAXTAG)
+                f->state=FILTER_SCAN;
+            break;
+        }
+        case FILTER_COMMENT:
+        case FILTER_CDATA:
+        {
+            const char *marker=(f->state==FILTER_COMMENT) ? "-->" : "]]>";
+            int n=(avail<Len-out) ? avail : Len-out;
+            int i;
+            for (i=0; i<n; i++)
+            {
+                Buffer[out++]=p[i];
+                if (f->match(marker,p[i]))
+                {
+                    f->state=FILTER_SCAN;
+                    i++;
+                    break;
+                }
+            }
+            f->ipos+=i;
+            break;
+        }
+        case FILTER_SKIP:
+        {
+            int i=0;
+            while (i<avail)
+            {
+                if (!f->matched)
+                {
+                    char *lt=(char *) memchr(p+i,'<',avail-i);
+                    if (!lt)
+                    {
+                        i=avail;
+                        break;
+                    }
+                    i=lt-p;
+                }
+                if (f->match("</programme",p[i++]))
+                {
+                    f->state=FILTER_SKIPEND;
+                    break;
+                }
+            }
+            f->ipos+=i;
+            break;
+        }
+        case FILTER_SKIPEND:
+        {
+            char *gt=(char *) memchr(p,'>',avail);
+            if (gt)
+            {
+                f->ipos+=gt-p+1;
+                f->state=FILTER_SCAN;
+            }
+            else
+            {
+                f->ipos=f->ilen;
+            }
+            break;
+        }
+        }
+    }
+    return out;
+}
+
+// -------------------------------------------------------
+
+cParseWorker::cParseWorker(cParse *Master, cEPGSource *Source, cGlobals *Global,
+                           cParseQueue *Queue) : cThread("xmltv2vdr parser")
+{
+    parse=new cParse(Source,Global,Master);
+    queue=Queue;
+}
+
+cParseWorker::~cParseWorker()
+{
+    delete parse;
+}
+
+void cParseWorker::Action()
+{
+    cParseJob *job;
+    while ((job=queue->Get()))
+    {
+        parse->PrepareJob(job);
+        queue->Done(job);
+    }
+}
+
+// -------------------------------------------------------
+
+cParseWriter::cParseWriter(cParse *Parse, cParseQueue *Queue, sqlite3 *Db) : cThread("xmltv2vdr writer")
+{
+    parse=Parse;
+    queue=Queue;
+    db=Db;
+    lerr=lweak=skipped=0;
+}
+
+void cParseWriter::Action()
+{
+    cParseJob *job;
+    while ((job=queue->Next()))
+    {
+        parse->StoreJob(db,job,lerr,lweak,skipped);
+        delete job;
+    }
+}
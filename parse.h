@@ -9,16 +9,170 @@
 #define _PARSE_H
 
 #include <vdr/epg.h>
+#include <vdr/thread.h>
+#include <sqlite3.h>
 #include <libxml/parser.h>
+#include <libxml/xmlreader.h>
 #include <time.h>
 
 #include "maps.h"
 #include "event.h"
+#include "tz.h"
 
 class cEPGExecutor;
 class cEPGSource;
 class cEPGMappings;
+class cEPGMapping;
 class cGlobals;
+class cParse;
+class cParseFilter;
+
+class cParseJob
+{
+public:
+    cParseJob();
+    ~cParseJob();
+    xmlNodePtr node;
+    bool ownnode;
+    cEPGMapping *map;
+    time_t starttime;
+    int duration;
+    int line;
+    bool done;
+    bool fetched;
+    bool weak;
+    tEventID eventid;
+    char *title;
+    uint64_t hash;
+    int channels;
+    cXMLTVValues values;
+};
+
+#define PARSEQUEUESIZE 256
+
+// the first import of a source switches to a bulk load after this
+// many new events, if the table doesn't hold more rows already
+#define PARSEBULKROWS 10000
+
+class cParseQueue
+{
+private:
+    cMutex mutex;
+    cCondVar changed;
+    cParseJob *jobs[PARSEQUEUESIZE];
+    int produced;
+    int dispatched;
+    int written;
+    bool finished;
+    bool aborted;
+public:
+    cParseQueue();
+    ~cParseQueue();
+    bool Put(cParseJob *Job);
+    cParseJob *Get();
+    void Done(cParseJob *Job);
+    cParseJob *Next();
+    void Finish();
+    void Abort();
+    bool Aborted();
+};
+
+class cParseWorker : public cThread
+{
+private:
+    cParse *parse;
+    cParseQueue *queue;
+public:
+    cParseWorker(cParse *Master, cEPGSource *Source, cGlobals *Global, cParseQueue *Queue);
+    ~cParseWorker();
+    virtual void Action();
+};
+
+class cParseWriter : public cThread
+{
+private:
+    cParse *parse;
+    cParseQueue *queue;
+    sqlite3 *db;
+public:
+    cParseWriter(cParse *Parse, cParseQueue *Queue, sqlite3 *Db);
+    virtual void Action();
+    int lerr;
+    int lweak;
+    int skipped;
+};
+
+#define PARSEFILTERBUFSIZE 65536
+#define PARSEFILTERMAXTAG 4096
+
+class cParseFilter
+{
+private:
+    enum
+    {
+        FILTER_SCAN,
+        FILTER_PREFIX,
+        FILTER_TAG,
+        FILTER_COMMENT,
+        FILTER_CDATA,
+        FILTER_SKIP,
+        FILTER_SKIPEND
+    };
+    cEPGSource *source;
+    cGlobals *g;
+    xmlInputReadCallback readcallback;
+    void *context;
+    char *ibuf;
+    int ilen;
+    int ipos;
+    bool inputeof;
+    char *tag;
+    int taglen;
+    int tagpos;
+    char quote;
+    int state;
+    int matched;
+    char *lastid;
+    bool lastmapped;
+    int skipped;
+    bool flush();
+    bool match(const char *Marker, char c);
+    bool mapped();
+public:
+    cParseFilter(cEPGSource *Source, cGlobals *Global, xmlInputReadCallback ReadCallback, void *Context);
+    ~cParseFilter();
+    static int Read(void *Context, char *Buffer, int Len);
+    int Skipped()
+    {
+        return skipped;
+    }
+};
+
+class cParsePics
+{
+private:
+    cMutex mutex;
+    cStringList dirs;
+    cStringList statdirs;
+    char **names;
+    int size;
+    int count;
+    int missing;
+    static unsigned int hash(const char *Name);
+    static char *normalize(const char *Path);
+    bool contains(const char *Name);
+    void insert(char *Name);
+    void scan(const char *Dir);
+public:
+    cParsePics();
+    ~cParsePics();
+    void Clear();
+    bool Exists(const char *Path);
+    int Missing()
+    {
+        return missing;
+    }
+};
 
 class cParse
 {
@@ -33,23 +187,88 @@ class cParse
         PARSE_NOEVENTID
     };
 
+    enum
+    {
+        ELEMENT_UNKNOWN=0,
+        ELEMENT_PROGRAMME,
+        ELEMENT_TITLE,
+        ELEMENT_SUBTITLE,
+        ELEMENT_DESC,
+        ELEMENT_CREDITS,
+        ELEMENT_DATE,
+        ELEMENT_CATEGORY,
+        ELEMENT_COUNTRY,
+        ELEMENT_VIDEO,
+        ELEMENT_AUDIO,
+        ELEMENT_RATING,
+        ELEMENT_STARRATING,
+        ELEMENT_REVIEW,
+        ELEMENT_ICON,
+        ELEMENT_EPISODENUM,
+        ELEMENT_IGNORE,
+        ELEMENT_ACTOR,
+        ELEMENT_COLOUR,
+        ELEMENT_ASPECT,
+        ELEMENT_QUALITY,
+        ELEMENT_STEREO,
+        ELEMENT_VALUE
+    };
+
+#define ELEMENTCACHESIZE 128
+
+    struct elementcache
+    {
+        const xmlChar *name;
+        unsigned int hash;
+        int element;
+    };
+
 private:
     cGlobals *g;  
+    cParse *master;
     iconv_t cep2ascii;
     iconv_t cutf2ascii;
     cEPGSource *source;
     cXMLTVEvent xevent;
-    time_t ConvertXMLTVTime2UnixTime(char *xmltvtime);
+    cXMLTVZones zones;
+    cParsePics pics;
+    sqlite3_stmt *hashstmt;
+    sqlite3_stmt *insertstmt;
+    sqlite3_stmt *updatestmt;
+    sqlite3_stmt *upsertstmt;
+    sqlite3_int64 srcid;
+    // keys of the channels of the last stored mapping
+    cEPGMapping *chidmap;
+    cVector<sqlite3_int64> chids;
+    bool channelkeys(sqlite3 *Db, cEPGMapping *Map);
+    // the secondary indexes are dropped during a bulk load
+    bool bulk;
+    sqlite3_int64 bulkrows;
+    void bulkload(sqlite3 *Db);
+    int inserted;
+    int updated;
+    int unchanged;
+    struct elementcache elements[ELEMENTCACHESIZE];
+    static int LookupElement(const xmlChar *Name);
+    struct elementcache *ElementCache(const xmlChar *Name);
+    int ElementType(const xmlChar *Name);
+    cMutex unknownmutex;
+    cStringList unknownnames;
+    cVector<int> unknowncounts;
+    void UnknownElement(const xmlChar *Name);
     bool FetchEvent(xmlNodePtr node, bool useeptext);
+    int Process(cEPGExecutor &myExecutor, xmlTextReaderPtr reader, cParseFilter *Filter=NULL);
 public:
-    cParse(cEPGSource *Source, cGlobals *Global);
+    cParse(cEPGSource *Source, cGlobals *Global, cParse *Master=NULL);
     ~cParse();
-    int Process(cEPGExecutor &myExecutor, char *buffer, int bufsize);
+    void PrepareJob(cParseJob *Job);
+    void StoreJob(sqlite3 *Db, cParseJob *Job, int &lerr, int &lweak, int &skipped);
+    int Process(cEPGExecutor &myExecutor, xmlInputReadCallback ReadCallback, void *Context);
     static void RemoveNonAlphaNumeric(char *String, bool InDescription=false);
     static bool FetchSeasonEpisode(iconv_t cEP2ASCII, iconv_t cUTF2ASCII, const char *EPDir,
                                    const char *Title, const char *ShortText, const char *Description,
                                    int &Season, int &Episode, int &EpisodeOverall, char **EPShortText,
-                                   char **EPTitle);
+                                   char **EPTitle, int *NotFound=NULL);
     static void InitLibXML();
     static void CleanupLibXML();
 };
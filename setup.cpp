@@ -66,6 +66,14 @@ cMenuSetupXmltv2vdr::cMenuSetupXmltv2vdr(cGlobals *Global)
     wakeup=g->WakeUp();
     imgdelafter=g->ImgDelAfter();
     if (imgdelafter<=6) imgdelafter=6;
+    parsethreads=g->ParseThreads();
+    eplistscache=g->EPListsCache();
+    eplistsfuzzy=g->EPListsFuzzy();
+    dbprofile=g->DBProfile();
+    dbclustered=g->DBClustered();
+    dbprofiles[DBPROFILE_STANDARD]=tr("standard");
+    dbprofiles[DBPROFILE_WAL]=tr("write-ahead log");
+    dbprofiles[DBPROFILE_WALNOSYNC]=tr("write-ahead log, no sync");
     cs=NULL;
     cm=NULL;
     Output();
@@ -106,6 +114,14 @@ void cMenuSetupXmltv2vdr::Output(void)
     {
         Add(new cMenuEditIntItem(tr("delete pics after (days)"),&imgdelafter,6,365,tr("never")),true);
     }
+    Add(new cMenuEditIntItem(tr("parser threads"),&parsethreads,0,16,tr("auto")),true);
+    if (g->EPDir())
+    {
+        Add(new cMenuEditIntItem(tr("eplists cache (MB)"),&eplistscache,1,256),true);
+        Add(new cMenuEditIntItem(tr("eplists fuzzy match (%)"),&eplistsfuzzy,0,100,tr("off")),true);
+    }
+    Add(new cMenuEditStraItem(tr("database tuning"),&dbprofile,DBPROFILES,dbprofiles),true);
+    Add(new cMenuEditBoolItem(tr("clustered epg table"),&dbclustered),true);
 
     Add(new cOsdItem(tr("text mapping")),true);
     mappingEntry=Current();
@@ -257,9 +273,19 @@ void cMenuSetupXmltv2vdr::Store(void)
     SetupStore("options.epall",epall);
     SetupStore("options.wakeup",wakeup);
     SetupStore("options.imgdelafter",imgdelafter);
+    SetupStore("options.parsethreads",parsethreads);
+    SetupStore("options.eplistscache",eplistscache);
+    SetupStore("options.eplistsfuzzy",eplistsfuzzy);
+    SetupStore("options.dbprofile",dbprofile);
+    SetupStore("options.dbclustered",dbclustered);
     g->SetEPAll(epall);
     g->SetWakeUp((bool) wakeup);
     g->SetImgDelAfter(imgdelafter);
+    g->SetParseThreads(parsethreads);
+    g->SetEPListsCache(eplistscache);
+    g->SetEPListsFuzzy(eplistsfuzzy);
+    g->SetDBProfile(dbprofile);
+    g->SetDBClustered((bool) dbclustered);
 }
 
 eOSState cMenuSetupXmltv2vdr::edit()
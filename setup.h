@@ -44,6 +44,12 @@ private:
     unsigned int epall;
     int wakeup;
     int imgdelafter;
+    int parsethreads;
+    int eplistscache;
+    int eplistsfuzzy;
+    int dbprofile;
+    int dbclustered;
+    const char *dbprofiles[DBPROFILES];
 public:
     void Output(void);
     static cOsdItem *NewTitle(const char *s);
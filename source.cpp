@@ -34,6 +34,131 @@ int cEPGChannel::Compare(const cListObject &ListObject) const
 
 // -------------------------------------------------------------
 
+cEPGPipeReader::cEPGPipeReader(cEPGSource *Source, cExtPipe *Pipe, cEPGExecutor *Executor)
+{
+    source=Source;
+    pipe=Pipe;
+    executor=Executor;
+    r_err=NULL;
+    l_err=0;
+    returncode=0;
+    outopen=true;
+    erropen=true;
+    closed=false;
+    stopped=false;
+}
+
+cEPGPipeReader::~cEPGPipeReader()
+{
+    closepipe();
+    if (r_err) free(r_err);
+}
+
+bool cEPGPipeReader::readerr()
+{
+    int n;
+    if (ioctl(pipe->Err(),FIONREAD,&n)<0)
+    {
+        n=1;
+    }
+    char *tmp=(char *) realloc(r_err, l_err+n+1);
+    if (!tmp)
+    {
+        // out of memory, drain stderr anyway
+        free(r_err);
+        r_err=NULL;
+        l_err=0;
+        char dummy[256];
+        return (read(pipe->Err(),dummy,sizeof(dummy))!=0);
+    }
+    r_err=tmp;
+    int l=read(pipe->Err(),r_err+l_err,n);
+    if (l>0)
+    {
+        l_err+=l;
+    }
+    r_err[l_err]=0;
+    return (l!=0);
+}
+
+void cEPGPipeReader::closepipe()
+{
+    if (closed) return;
+    closed=true;
+    int status;
+    if (pipe->Close(status)>0)
+    {
+        returncode=WEXITSTATUS(status);
+    }
+    else
+    {
+        returncode=-1;
+    }
+}
+
+int cEPGPipeReader::ReturnCode()
+{
+    closepipe();
+    return returncode;
+}
+
+int cEPGPipeReader::Read(void *Context, char *Buffer, int Len)
+{
+    // xmlInputReadCallback, blocks until output from the epgsource
+    // is available, returns 0 on eof and -1 on error
+    cEPGPipeReader *reader=(cEPGPipeReader *) Context;
+    if (!reader) return -1;
+    if (reader->closed) return reader->returncode ? -1 : 0;
+
+    for (;;)
+    {
+        if (!reader->executor->StillRunning())
+        {
+            reader->stopped=true;
+            reader->closepipe();
+            return -1;
+        }
+        if ((!reader->outopen) && (!reader->erropen))
+        {
+            // epgsource closed stdout and stderr, check exit code
+            reader->closepipe();
+            return reader->returncode ? -1 : 0;
+        }
+        struct pollfd fds[2];
+        fds[0].fd=reader->outopen ? reader->pipe->Out() : -1;
+        fds[0].events=POLLIN;
+        fds[1].fd=reader->erropen ? reader->pipe->Err() : -1;
+        fds[1].events=POLLIN;
+        if (poll(fds,2,500)<0)
+        {
+            if (errno==EINTR) continue;
+            esyslogs(reader->source,"failed polling");
+            reader->closepipe();
+            return -1;
+        }
+        if (fds[1].revents & POLLIN)
+        {
+            if (!reader->readerr()) reader->erropen=false;
+        }
+        else if (fds[1].revents & (POLLHUP|POLLERR|POLLNVAL))
+        {
+            reader->erropen=false;
+        }
+        if (fds[0].revents & POLLIN)
+        {
+            int l=read(reader->pipe->Out(),Buffer,Len);
+            if (l>0) return l;
+            if ((!l) || ((errno!=EINTR) && (errno!=EAGAIN))) reader->outopen=false;
+        }
+        else if (fds[0].revents & (POLLHUP|POLLERR|POLLNVAL))
+        {
+            reader->outopen=false;
+        }
+    }
+}
+
+// -------------------------------------------------------------
+
 cEPGExecutor::cEPGExecutor(cEPGSources *Sources) : cThread("xmltv2vdr importer")
 {
     sources=Sources;
@@ -124,6 +249,71 @@ void cEPGExecutor::Action()
 
 // -------------------------------------------------------------
 
+cEPGFileReader::cEPGFileReader(cEPGSource *Source)
+{
+    source=Source;
+    fname=NULL;
+    fd=-1;
+    failed=false;
+}
+
+cEPGFileReader::~cEPGFileReader()
+{
+    if (fd!=-1) close(fd);
+    if (fname) free(fname);
+}
+
+int cEPGFileReader::Open(const char *FileName)
+{
+    fname=strdup(FileName);
+    if (!fname)
+    {
+        esyslogs(source,"out of memory");
+        return 134;
+    }
+    dsyslogs(source,"reading from '%s'",fname);
+
+    fd=open(fname,O_RDONLY);
+    if (fd==-1)
+    {
+        esyslogs(source,"failed to open '%s'",fname);
+        return 157;
+    }
+
+    struct stat statbuf;
+    if (fstat(fd,&statbuf)==-1)
+    {
+        esyslogs(source,"failed to stat '%s'",fname);
+        return 157;
+    }
+    if (!statbuf.st_size) return 134;
+    posix_fadvise(fd,0,0,POSIX_FADV_SEQUENTIAL);
+    return 0;
+}
+
+int cEPGFileReader::Read(void *Context, char *Buffer, int Len)
+{
+    // xmlInputReadCallback, reads straight into the buffer of the parser
+    cEPGFileReader *reader=(cEPGFileReader *) Context;
+    if ((!reader) || (reader->fd==-1)) return -1;
+    if (reader->failed) return -1;
+    ssize_t n;
+    do
+    {
+        n=read(reader->fd,Buffer,Len);
+    }
+    while ((n==-1) && (errno==EINTR));
+    if (n==-1)
+    {
+        esyslogs(reader->source,"failed to read '%s'",reader->fname);
+        reader->failed=true;
+        return -1;
+    }
+    return (int) n;
+}
+
+// -------------------------------------------------------------
+
 cEPGSource::cEPGSource(const char *Name, cGlobals *Global)
 {
     if (strcmp(Name,EITSOURCE))
@@ -140,6 +330,7 @@ cEPGSource::cEPGSource(const char *Name, cGlobals *Global)
     needpin=false;
     running=false;
     haspics=usepics=false;
+    compression=COMPRESSION_NONE;
     daysinadvance=1;
     exec_time=15;
     exec_weekday=127; // Mon->Sun
@@ -219,6 +410,8 @@ bool cEPGSource::RunItNow(bool ForceDownload)
 
 bool cEPGSource::ReadConfig()
 {
+    // the field is optional, a reloaded config may have dropped it
+    compression=COMPRESSION_NONE;
     char *fname=NULL;
     if (asprintf(&fname,"%s/%s",EPGSOURCES,name)==-1)
     {
@@ -292,6 +485,20 @@ bool cEPGSource::ReadConfig()
                             dsyslogs(this,"is providing pics");
                             haspics=true;
                         }
+
+                        char *comp=strchr(pics,';');
+                        if (comp)
+                        {
+                            *comp=0;
+                            comp++;
+                            comp=compactspace(comp);
+                            compression=cEPGDecompressor::Compression(comp);
+                            if (compression!=COMPRESSION_NONE)
+                            {
+                                dsyslogs(this,"is providing %s compressed data",
+                                         cEPGDecompressor::Name(compression));
+                            }
+                        }
                     }
                 }
             }
@@ -409,52 +616,21 @@ bool cEPGSource::ReadConfig()
     return true;
 }
 
-int cEPGSource::ReadOutput(char *&result, size_t &l)
+void cEPGSource::LogScriptErrors(char *r_err)
 {
-    int ret=0;
-    char *fname=NULL;
-    if (asprintf(&fname,"%s/%s.xmltv",EPGSOURCES,name)==-1)
-    {
-        esyslogs(this,"out of memory");
-        return 134;
-    }
-    dsyslogs(this,"reading from '%s'",fname);
-
-    int fd=open(fname,O_RDONLY);
-    if (fd==-1)
-    {
-        esyslogs(this,"failed to open '%s'",fname);
-        free(fname);
-        return 157;
-    }
-
-    struct stat statbuf;
-    if (fstat(fd,&statbuf)==-1)
-    {
-        esyslogs(this,"failed to stat '%s'",fname);
-        close(fd);
-        free(fname);
-        return 157;
-    }
-    l=statbuf.st_size;
-    result=(char *) malloc(l+1);
-    if (!result)
-    {
-        close(fd);
-        free(fname);
-        esyslogs(this,"out of memory");
-        return 134;
-    }
-    if (read(fd,result,statbuf.st_size)!=statbuf.st_size)
+    if (!r_err) return;
+    char *saveptr;
+    char *pch=strtok_r(r_err,"\n",&saveptr);
+    char *last=(char *) "";
+    while (pch)
     {
-        esyslogs(this,"failed to read '%s'",fname);
-        ret=149;
-        free(result);
-        result=NULL;
+        if (strcmp(last,pch))
+        {
+            esyslogs(this,"(script) %s",pch);
+            last=pch;
+        }
+        pch=strtok_r(NULL,"\n",&saveptr);
     }
-    close(fd);
-    free(fname);
-    return ret;
 }
 
 int cEPGSource::Import(cEPGExecutor &myExecutor)
@@ -564,6 +740,38 @@ int cEPGSource::Execute(cEPGExecutor &myExecutor)
     dsyslogs(this,"executing epgsource");
     running=true;
 
+    if (usepipe)
+    {
+        // feed the output into the parser while the epgsource is still running
+        cEPGPipeReader reader(this,&p,&myExecutor);
+        cEPGDecompressor input(this,cEPGPipeReader::Read,&reader);
+        ret=parse->Process(myExecutor,cEPGDecompressor::Read,&input);
+        int returncode=reader.ReturnCode();
+        LogScriptErrors(reader.Err());
+        if (reader.Stopped())
+        {
+            isyslogs(this,"request to stop from vdr");
+            running=false;
+            return 0;
+        }
+        if (returncode<0)
+        {
+            esyslogs(this,"failed to execute");
+            ret=126;
+        }
+        else if (returncode)
+        {
+            esyslogs(this,"epgsource returned %i",returncode);
+            ret=returncode;
+        }
+        running=false;
+        if (!ret)
+        {
+            lastretcode=ret;
+        }
+        return ret;
+    }
+
     int fdsopen=2;
     while (fdsopen>0)
     {
@@ -652,67 +860,50 @@ int cEPGSource::Execute(cEPGExecutor &myExecutor)
     if (r_out) r_out[l_out]=0;
     if (r_err) r_err[l_err]=0;
 
-    if (r_err)
+    LogScriptErrors(r_err);
+    if (r_err) free(r_err);
+
+    int status;
+    if (p.Close(status)>0)
     {
-        char *saveptr;
-        char *pch=strtok_r(r_err,"\n",&saveptr);
-        char *last=(char *) "";
-        while (pch)
+        int returncode=WEXITSTATUS(status);
+        if (!returncode)
         {
-            if (strcmp(last,pch))
+            char *fname=NULL;
+            if (compression!=COMPRESSION_NONE)
             {
-                esyslogs(this,"(script) %s",pch);
-                last=pch;
+                // prefer <name>.xmltv.<suffix> if the source advertises compression
+                struct stat statbuf;
+                if (asprintf(&fname,"%s/%s.xmltv%s",EPGSOURCES,name,
+                             cEPGDecompressor::Suffix(compression))==-1) fname=NULL;
+                if ((fname) && (stat(fname,&statbuf)==-1))
+                {
+                    free(fname);
+                    fname=NULL;
+                }
             }
-            pch=strtok_r(NULL,"\n",&saveptr);
-        }
-        free(r_err);
-    }
-
-    if (usepipe)
-    {
-        int status;
-        if (p.Close(status)>0)
-        {
-            int returncode=WEXITSTATUS(status);
-            if ((!returncode) && (r_out))
+            if ((!fname) && (asprintf(&fname,"%s/%s.xmltv",EPGSOURCES,name)==-1))
             {
-                ret=parse->Process(myExecutor,r_out,l_out);
+                esyslogs(this,"out of memory");
+                ret=134;
             }
             else
             {
-                esyslogs(this,"epgsource returned %i",returncode);
-                ret=returncode;
+                cEPGFileReader reader(this);
+                ret=reader.Open(fname);
+                if (!ret)
+                {
+                    cEPGDecompressor input(this,cEPGFileReader::Read,&reader);
+                    ret=parse->Process(myExecutor,cEPGDecompressor::Read,&input);
+                    if (reader.Failed()) ret=149;
+                }
+                free(fname);
             }
         }
         else
         {
-            esyslogs(this,"failed to execute");
-            ret=126;
-        }
-    }
-    else
-    {
-        int status;
-        if (p.Close(status)>0)
-        {
-            int returncode=WEXITSTATUS(status);
-            if (!returncode)
-            {
-                size_t l;
-                char *result=NULL;
-                ret=ReadOutput(result,l);
-                if ((!ret) && (result))
-                {
-                    ret=parse->Process(myExecutor,result,l);
-                }
-                if (result) free(result);
-            }
-            else
-            {
-                esyslogs(this,"epgsource returned %i",returncode);
-                ret=returncode;
-            }
+            esyslogs(this,"epgsource returned %i",returncode);
+            ret=returncode;
         }
     }
     if (r_out) free(r_out);
@@ -791,6 +982,8 @@ void cEPGSource::Add2Log(struct tm *Tm, const char Prefix, const char *Line)
     char dt[30];
     strftime(dt,sizeof(dt)-1,"%H:%M ",Tm);
 
+    cMutexLock lock(&logmutex);
+
     loglen+=strlen(Line)+3+strlen(dt);
     char *nptr=(char *) realloc(Log,loglen);
     if (nptr)
@@ -885,7 +1078,7 @@ bool cEPGSources::MoveEPGSource(cGlobals *Global, int From, int To)
     if (From==To) return false;
 
     sqlite3 *db=NULL;
-    if (sqlite3_open_v2(Global->EPGFile(),&db,SQLITE_OPEN_READWRITE,NULL)==SQLITE_OK)
+    if (Global->OpenDB(&db,SQLITE_OPEN_READWRITE)==SQLITE_OK)
     {
         char *sql=NULL;
         if (asprintf(&sql,"BEGIN TRANSACTION;" \
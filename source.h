@@ -9,10 +9,12 @@
 #define __source_h
 
 #include <vdr/tools.h>
+#include <vdr/thread.h>
 
 #include "maps.h"
 #include "import.h"
 #include "parse.h"
+#include "decompress.h"
 #include "debug.h"
 
 #define EPGSOURCES "/var/lib/epgsources" // NEVER (!) CHANGE THIS
@@ -46,6 +48,57 @@ class cEPGChannels : public cList<cEPGChannel> {};
 
 class cImport;
 class cGlobals;
+class cEPGSource;
+class cEPGExecutor;
+class cExtPipe;
+
+class cEPGPipeReader
+{
+private:
+    cEPGSource *source;
+    cExtPipe *pipe;
+    cEPGExecutor *executor;
+    char *r_err;
+    int l_err;
+    int returncode;
+    bool outopen;
+    bool erropen;
+    bool closed;
+    bool stopped;
+    bool readerr();
+    void closepipe();
+public:
+    cEPGPipeReader(cEPGSource *Source, cExtPipe *Pipe, cEPGExecutor *Executor);
+    ~cEPGPipeReader();
+    static int Read(void *Context, char *Buffer, int Len);
+    int ReturnCode();
+    bool Stopped()
+    {
+        return stopped;
+    }
+    char *Err()
+    {
+        return r_err;
+    }
+};
+
+class cEPGFileReader
+{
+private:
+    cEPGSource *source;
+    char *fname;
+    int fd;
+    bool failed;
+public:
+    cEPGFileReader(cEPGSource *Source);
+    ~cEPGFileReader();
+    int Open(const char *FileName);
+    static int Read(void *Context, char *Buffer, int Len);
+    bool Failed()
+    {
+        return failed;
+    }
+};
 
 class cEPGSource : public cListObject
 {
@@ -55,6 +108,7 @@ private:
     const char *pin;
     const char *epgfile;
     int loglen;
+    cMutex logmutex;
     cParse *parse;
     cImport *import;
     bool ready2parse;
@@ -64,13 +118,14 @@ private:
     bool disabled;
     bool haspics;
     bool usepics;
+    int compression;
     int daysinadvance;
     int exec_weekday;
     int exec_time;
     int daysmax;
     int lastretcode;
     bool ReadConfig();
-    int ReadOutput(char *&result, size_t &l);
+    void LogScriptErrors(char *r_err);
     cEPGChannels channels;
 public:
     cEPGSource(const char *Name, cGlobals *Global);
@@ -0,0 +1,442 @@
+/*
+ * dbtest.cpp: A plugin for the Video Disk Recorder
+ *
+ * See the README file for copyright information and how to reach the author.
+ *
+ */
+
+// Checks cGlobals::UpgradeDB on in-memory databases: a new database,
+// the tables of former plugin versions with their rows, a table the
+// migrations don't know, and a database of a newer plugin. Then the
+// plans of the expiry and of the import window must be range searches
+// on idx4. With -b both table layouts are filled with 2 million rows and
+// timed on the queries of the EPG handler, the import and the expiry.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "xmltv2vdr.h"
+
+// the table of the last unversioned plugin
+static const char schema0[]="CREATE TABLE epg (" \
+                             "src nvarchar(100), channelid nvarchar(255), eventid int, eiteventid int, "\
+                             "starttime datetime, duration int, title nvarchar(255), alttitle nvarchar(255), "\
+                             "origtitle nvarchar(255), shorttext nvarchar(255), description text, "\
+                             "eitdescription text, country nvarchar(255), year int, " \
+                             "credits text, category text, review text, rating text, " \
+                             "starrating text, video text, audio text, season int, episode int, " \
+                             "episodeoverall int, pics text, srcidx int," \
+                             "PRIMARY KEY(eventid, src, channelid)" \
+                             ");" \
+                             "CREATE INDEX idx1 on epg (starttime, eiteventid, channelid); " \
+                             "CREATE INDEX idx2 on epg (starttime, title, channelid); " \
+                             "CREATE INDEX idx3 on epg (starttime, duration, src);" \
+                             "INSERT INTO epg (src,channelid,eventid,starttime,duration,title,srcidx) " \
+                             "VALUES ('test','S19.2E-1-1-1',1,1719835200,1800,'Eins',1);" \
+                             "INSERT INTO epg (src,channelid,eventid,starttime,duration,title,srcidx) " \
+                             "VALUES ('test','S19.2E-1-1-2',2,1719837000,3600,'Zwei',1);" \
+                             "INSERT INTO epg (src,channelid,eventid,starttime,duration,title,srcidx) " \
+                             "VALUES ('other','S19.2E-1-1-1',3,1719840600,900,'Drei',2);";
+
+// an early table without most of the later columns
+static const char schemaold[]="CREATE TABLE epg (" \
+                              "src nvarchar(100), channelid nvarchar(255), eventid int, " \
+                              "starttime datetime, duration int, title nvarchar(255), " \
+                              "shorttext nvarchar(255), description text, country nvarchar(255), year int, " \
+                              "credits text, category text, review text, rating text, " \
+                              "starrating text, video text, audio text, season int, episode int, pics text, " \
+                              "PRIMARY KEY(eventid, src, channelid)" \
+                              ");" \
+                              "INSERT INTO epg (src,channelid,eventid,starttime,duration,title) " \
+                              "VALUES ('test','S19.2E-1-1-1',1,1719835200,1800,'Eins');" \
+                              "INSERT INTO epg (src,channelid,eventid,starttime,duration,title) " \
+                              "VALUES ('test','S19.2E-1-1-2',2,1719837000,3600,'Zwei');" \
+                              "INSERT INTO epg (src,channelid,eventid,starttime,duration,title) " \
+                              "VALUES ('other','S19.2E-1-1-1',3,1719840600,900,'Drei');";
+
+// no channelid, nothing to migrate from
+static const char schemabroken[]="CREATE TABLE epg (src nvarchar(100), eventid int, title nvarchar(255));" \
+                                 "INSERT INTO epg VALUES ('test',1,'Eins');";
+
+static int failed=0;
+
+static void expect(const char *Test, bool Ok, const char *What)
+{
+    if (Ok) return;
+    printf("dbtest: %s: %s\n",Test,What);
+    failed++;
+}
+
+static sqlite3_int64 query(sqlite3 *Db, const char *SQL)
+{
+    // the first column of the first row, -1 on errors
+    sqlite3_stmt *stmt;
+    if (sqlite3_prepare_v2(Db,SQL,-1,&stmt,NULL)!=SQLITE_OK) return -1;
+    sqlite3_int64 ret=-1;
+    if (sqlite3_step(stmt)==SQLITE_ROW) ret=sqlite3_column_int64(stmt,0);
+    sqlite3_finalize(stmt);
+    return ret;
+}
+
+static sqlite3 *opendb(const char *SQL)
+{
+    sqlite3 *db;
+    if (sqlite3_open(":memory:",&db)!=SQLITE_OK)
+    {
+        sqlite3_close(db);
+        return NULL;
+    }
+    if ((SQL) && (sqlite3_exec(db,SQL,NULL,NULL,NULL)!=SQLITE_OK))
+    {
+        printf("dbtest: %s\n",sqlite3_errmsg(db));
+        sqlite3_close(db);
+        return NULL;
+    }
+    return db;
+}
+
+static void checkcurrent(const char *Test, sqlite3 *Db, int Rows)
+{
+    expect(Test,query(Db,"PRAGMA user_version")==EPGDBVERSION,"wrong schema version");
+    expect(Test,query(Db,"SELECT count(*) FROM epg")==Rows,"wrong number of rows");
+    // all columns of the current schema, with the keys resolved
+    expect(Test,query(Db,"SELECT count(*) FROM epg JOIN sources USING (srcid) JOIN channels USING (chid) " \
+                      "WHERE endtime=starttime+duration AND hash IS NULL AND epstamp IS NULL AND " \
+                      "alttitle IS NULL AND eitdescription IS NULL AND eiteventid IS NULL")==Rows,
+           "rows not migrated");
+    expect(Test,query(Db,"SELECT count(*) FROM sqlite_master WHERE type='index' AND " \
+                      "name IN ('idx1','idx2','idx3','idx4')")==4,"indexes missing");
+}
+
+static void check(cGlobals &Globals, const char *Test, const char *SQL, int Rows)
+{
+    sqlite3 *db=opendb(SQL);
+    if (!db)
+    {
+        expect(Test,false,"cannot create database");
+        return;
+    }
+    expect(Test,Globals.UpgradeDB(db),"upgrade failed");
+    checkcurrent(Test,db,Rows);
+    if (Rows==3)
+    {
+        expect(Test,query(db,"SELECT count(*) FROM epg JOIN sources USING (srcid) JOIN channels USING (chid) " \
+                          "WHERE src='other' AND channelid='S19.2E-1-1-1' AND eventid=3 AND title='Drei' AND " \
+                          "endtime=1719841500")==1,"row not found by source and channel");
+    }
+    // a second upgrade doesn't change anything
+    expect(Test,Globals.UpgradeDB(db),"second upgrade failed");
+    checkcurrent(Test,db,Rows);
+    sqlite3_close(db);
+}
+
+static void checkclustered(cGlobals &Globals)
+{
+    sqlite3 *db=opendb(schema0);
+    if (!db)
+    {
+        expect("clustered",false,"cannot create database");
+        return;
+    }
+    for (int clustered=1; clustered>=0; clustered--)
+    {
+        const char *test=clustered ? "clustered" : "with rowid";
+        Globals.SetDBClustered(clustered);
+        expect(test,Globals.UpgradeDB(db),"upgrade failed");
+        checkcurrent(test,db,3);
+        expect(test,query(db,"SELECT count(*) FROM sqlite_master WHERE name='epg' AND " \
+                          "sql LIKE '%WITHOUT ROWID%'")==clustered,"wrong table layout");
+    }
+    sqlite3_close(db);
+}
+
+static void checknewer(cGlobals &Globals)
+{
+    char sql[64];
+    snprintf(sql,sizeof(sql),"PRAGMA user_version=%i",EPGDBVERSION+1);
+    sqlite3 *db=opendb(schemabroken);
+    if ((!db) || (sqlite3_exec(db,sql,NULL,NULL,NULL)!=SQLITE_OK))
+    {
+        expect("newer",false,"cannot create database");
+        if (db) sqlite3_close(db);
+        return;
+    }
+    expect("newer",!Globals.UpgradeDB(db),"upgrade of a newer schema succeeded");
+    expect("newer",query(db,"PRAGMA user_version")==EPGDBVERSION+1,"schema version changed");
+    expect("newer",query(db,"SELECT count(*) FROM epg")==1,"table changed");
+    sqlite3_close(db);
+}
+
+static bool searches(sqlite3 *Db, const char *SQL, const char *Range)
+{
+    // true if the plan searches epg by a range of idx4
+    char *sql;
+    if (asprintf(&sql,"EXPLAIN QUERY PLAN %s",SQL)==-1) return false;
+    sqlite3_stmt *stmt;
+    int ret=sqlite3_prepare_v2(Db,sql,-1,&stmt,NULL);
+    free(sql);
+    if (ret!=SQLITE_OK) return false;
+    bool found=false;
+    while (sqlite3_step(stmt)==SQLITE_ROW)
+    {
+        const char *detail=(const char *) sqlite3_column_text(stmt,3);
+        if ((detail) && (strstr(detail,"SEARCH")) && (strstr(detail,"epg")) && (strstr(detail,"idx4 (")) &&
+                (strstr(detail,Range)))
+            found=true;
+    }
+    sqlite3_finalize(stmt);
+    return found;
+}
+
+static void checkplans(cGlobals &Globals)
+{
+    for (int clustered=0; clustered<=1; clustered++)
+    {
+        const char *test=clustered ? "plans clustered" : "plans with rowid";
+        sqlite3 *db=opendb(NULL);
+        if (!db)
+        {
+            expect(test,false,"cannot create database");
+            continue;
+        }
+        Globals.SetDBClustered(clustered);
+        expect(test,Globals.UpgradeDB(db),"upgrade failed");
+        char *sql;
+        if (asprintf(&sql,EPGDBEXPIRESQL,(long) 1719835200)!=-1)
+        {
+            // srcid=? per source or ANY(srcid), a skip-scan over the sources
+            expect(test,searches(db,sql,"srcid) AND endtime<?)") || searches(db,sql,"srcid=? AND endtime<?)"),
+                   "expiry doesn't search idx4");
+            free(sql);
+        }
+        if (asprintf(&sql,EPGDBWINDOWSQL,"test",(long) 1719835200,(long) 1721044800)!=-1)
+        {
+            expect(test,searches(db,sql,"srcid=? AND endtime>? AND endtime<?)"),
+                   "import window doesn't search idx4");
+            free(sql);
+        }
+        sqlite3_close(db);
+    }
+}
+
+// -------------------------------------------------------
+
+static double now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC,&ts);
+    return ts.tv_sec+ts.tv_nsec/1e9;
+}
+
+#define BENCHSOURCES 2
+#define BENCHCHANNELS 1000
+#define BENCHDAYS 14
+#define BENCHPERDAY 72
+#define BENCHSTART 1719792000
+#define BENCHLOOKUPS 20000
+
+// the text lookup of the EPG handler in cImport::SearchXMLTVEvent
+static const char lookupsql[]="select channels.channelid,eventid,starttime,duration,title,origtitle,shorttext," \
+                              "description,country,year,credits,category,review,rating,starrating,video,audio," \
+                              "season,episode,episodeoverall,pics,sources.src,eiteventid,eitdescription,alttitle," \
+                              "abs(starttime-?1) as diff from epg join channels using (chid) join sources " \
+                              "using (srcid) where (starttime>=?2 and starttime<=?3) and title=?4 and " \
+                              "channels.channelid=?5 order by diff,srcidx asc limit 1;";
+
+static bool fill(sqlite3 *Db)
+{
+    // like daily imports, each day is added for all channels of both
+    // sources, so the rows of a channel are spread over the table
+    char *errmsg=NULL;
+    if (sqlite3_exec(Db,"PRAGMA journal_mode=OFF;PRAGMA synchronous=OFF;BEGIN",NULL,NULL,&errmsg)!=SQLITE_OK)
+    {
+        printf("dbtest: %s\n",errmsg);
+        sqlite3_free(errmsg);
+        return false;
+    }
+    sqlite3_int64 srcids[BENCHSOURCES],chids[BENCHCHANNELS];
+    char buf[512];
+    for (int i=0; i<BENCHSOURCES; i++)
+    {
+        snprintf(buf,sizeof(buf),"source%i",i);
+        srcids[i]=cXMLTVEvent::SourceKey(Db,buf);
+    }
+    for (int i=0; i<BENCHCHANNELS; i++)
+    {
+        snprintf(buf,sizeof(buf),"S19.2E-1-%i-%i",1+i/100,i);
+        chids[i]=cXMLTVEvent::ChannelKey(Db,buf);
+    }
+    sqlite3_stmt *stmt;
+    if (sqlite3_prepare_v2(Db,cXMLTVEvent::InsertSQL(),-1,&stmt,NULL)!=SQLITE_OK)
+    {
+        printf("dbtest: %s\n",sqlite3_errmsg(Db));
+        return false;
+    }
+    int ret=SQLITE_DONE;
+    for (int day=0; (day<BENCHDAYS) && (ret==SQLITE_DONE); day++)
+    {
+        for (int src=0; src<BENCHSOURCES; src++)
+        {
+            for (int ch=0; ch<BENCHCHANNELS; ch++)
+            {
+                for (int i=0; i<BENCHPERDAY; i++)
+                {
+                    cXMLTVValues values;
+                    int n=day*BENCHPERDAY+i;
+                    char title[64],shorttext[64];
+                    snprintf(title,sizeof(title),"Title %i",(ch*7+n)%500);
+                    snprintf(shorttext,sizeof(shorttext),"Folge %i: Die Rückkehr",n);
+                    snprintf(buf,sizeof(buf),"Der Kommissar ermittelt in einem Mordfall, die Spur führt " \
+                             "nach München. Als ihre Tochter %i verschwindet, gerät sie selbst unter " \
+                             "Verdacht. Regie: Max Mustermann, mit Erika Musterfrau und Hans Meier in der " \
+                             "Rolle des Kommissars.",n);
+                    values.SetNumber(XMLTVPARAM_SRCID,srcids[src]);
+                    values.SetNumber(XMLTVPARAM_CHID,chids[ch]);
+                    values.SetNumber(XMLTVPARAM_EVENTID,1+n);
+                    values.SetNumber(XMLTVPARAM_STARTTIME,BENCHSTART+n*(86400/BENCHPERDAY));
+                    values.SetNumber(XMLTVPARAM_DURATION,86400/BENCHPERDAY);
+                    values.SetText(XMLTVPARAM_TITLE,title);
+                    values.SetText(XMLTVPARAM_SHORTTEXT,shorttext);
+                    values.SetText(XMLTVPARAM_DESCRIPTION,buf);
+                    values.SetText(XMLTVPARAM_CREDITS,"actor|Erika Musterfrau@actor|Hans Meier");
+                    values.SetText(XMLTVPARAM_CATEGORY,"Krimi");
+                    values.SetNumber(XMLTVPARAM_SRCIDX,src);
+                    ret=values.Bind(stmt);
+                    if (ret==SQLITE_OK) ret=sqlite3_step(stmt);
+                    sqlite3_reset(stmt);
+                    if (ret!=SQLITE_DONE) break;
+                }
+            }
+        }
+    }
+    sqlite3_finalize(stmt);
+    if (ret!=SQLITE_DONE)
+    {
+        printf("dbtest: %s\n",sqlite3_errmsg(Db));
+        return false;
+    }
+    return (sqlite3_exec(Db,"COMMIT",NULL,NULL,NULL)==SQLITE_OK);
+}
+
+static double lookups(sqlite3 *Db)
+{
+    sqlite3_stmt *stmt;
+    if (sqlite3_prepare_v2(Db,lookupsql,-1,&stmt,NULL)!=SQLITE_OK) return -1;
+    srand(1);
+    int found=0;
+    double start=now();
+    for (int i=0; i<BENCHLOOKUPS; i++)
+    {
+        int ch=rand()%BENCHCHANNELS;
+        int n=rand()%(BENCHDAYS*BENCHPERDAY);
+        time_t starttime=BENCHSTART+n*(86400/BENCHPERDAY);
+        char title[64],channelid[64];
+        snprintf(title,sizeof(title),"Title %i",(ch*7+n)%500);
+        snprintf(channelid,sizeof(channelid),"S19.2E-1-%i-%i",1+ch/100,ch);
+        sqlite3_bind_int64(stmt,1,starttime);
+        sqlite3_bind_int64(stmt,2,starttime-300);
+        sqlite3_bind_int64(stmt,3,starttime+300);
+        sqlite3_bind_text(stmt,4,title,-1,SQLITE_STATIC);
+        sqlite3_bind_text(stmt,5,channelid,-1,SQLITE_STATIC);
+        if (sqlite3_step(stmt)==SQLITE_ROW) found++;
+        sqlite3_reset(stmt);
+    }
+    double t=now()-start;
+    sqlite3_finalize(stmt);
+    if (found!=BENCHLOOKUPS) printf("dbtest: only %i of %i lookups found\n",found,BENCHLOOKUPS);
+    return t;
+}
+
+static double timedsql(sqlite3 *Db, const char *SQL, int *Rows)
+{
+    sqlite3_stmt *stmt;
+    if (sqlite3_prepare_v2(Db,SQL,-1,&stmt,NULL)!=SQLITE_OK) return -1;
+    *Rows=0;
+    double start=now();
+    int ret;
+    while ((ret=sqlite3_step(stmt))==SQLITE_ROW) (*Rows)++;
+    double t=now()-start;
+    if (!*Rows) *Rows=sqlite3_changes(Db);
+    sqlite3_finalize(stmt);
+    return (ret==SQLITE_DONE) ? t : -1;
+}
+
+static void bench(cGlobals &Globals)
+{
+    // a file database, with the page cache of a new connection
+    char dbfile[]="/tmp/dbtestXXXXXX";
+    int fd=mkstemp(dbfile);
+    if (fd==-1)
+    {
+        printf("dbtest: cannot create temporary file\n");
+        return;
+    }
+    close(fd);
+    int rows=BENCHSOURCES*BENCHCHANNELS*BENCHDAYS*BENCHPERDAY;
+    for (int clustered=0; clustered<=1; clustered++)
+    {
+        const char *name=clustered ? "clustered" : "with rowid";
+        unlink(dbfile);
+        sqlite3 *db;
+        if (sqlite3_open(dbfile,&db)!=SQLITE_OK)
+        {
+            sqlite3_close(db);
+            break;
+        }
+        Globals.SetDBClustered(clustered);
+        double start=now();
+        bool ok=((Globals.UpgradeDB(db)) && (fill(db)));
+        double filltime=now()-start;
+        sqlite3_int64 size=query(db,"PRAGMA page_count")*query(db,"PRAGMA page_size");
+        sqlite3_close(db);
+        if ((!ok) || (sqlite3_open(dbfile,&db)!=SQLITE_OK))
+        {
+            sqlite3_close(db);
+            break;
+        }
+        printf("dbtest: %-10s %i rows stored in %6.2fs (%6.0f rows/s), %lli MB\n",name,rows,filltime,
+               rows/filltime,(long long) size/1048576);
+
+        double t=lookups(db);
+        printf("dbtest: %-10s %i handler lookups %8.1f us each\n",name,BENCHLOOKUPS,t*1e6/BENCHLOOKUPS);
+
+        char *sql;
+        int n;
+        if (asprintf(&sql,EPGDBWINDOWSQL,"source0",(long) BENCHSTART+86400*6,(long) BENCHSTART+86400*7)!=-1)
+        {
+            t=timedsql(db,sql,&n);
+            printf("dbtest: %-10s import window of one day %8.1f ms, %i rows\n",name,t*1e3,n);
+            free(sql);
+        }
+        if (asprintf(&sql,EPGDBEXPIRESQL,(long) BENCHSTART+86400)!=-1)
+        {
+            t=timedsql(db,sql,&n);
+            printf("dbtest: %-10s expiry of one day        %8.1f ms, %i rows\n",name,t*1e3,n);
+            free(sql);
+        }
+        sqlite3_close(db);
+    }
+    unlink(dbfile);
+}
+
+int main(int argc, char *argv[])
+{
+    cGlobals globals;
+    if ((argc>1) && (!strcmp(argv[1],"-b")))
+    {
+        bench(globals);
+        return 0;
+    }
+    check(globals,"new database",NULL,0);
+    check(globals,"version 0",schema0,3);
+    check(globals,"old columns",schemaold,3);
+    check(globals,"unknown schema",schemabroken,0);
+    checkclustered(globals);
+    checknewer(globals);
+    checkplans(globals);
+    printf("dbtest: %i failed\n",failed);
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,371 @@
+/*
+ * sqltest.cpp: A plugin for the Video Disk Recorder
+ *
+ * See the README file for copyright information and how to reach the author.
+ *
+ */
+
+// Stores events with texts that broke the former quoting through the
+// prepared statements and reads them back. With -b the former SQL text
+// with sqlite3_exec and the prepared, bound statements are timed on an
+// in-memory database, in rows per second.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <string>
+#include <regex>
+
+#include "xmltv2vdr.h"
+
+#define BENCHROWS 100000
+#define BENCHCHANNELS 50
+
+// the table the former statements were written for
+static const char oldschema[]="CREATE TABLE epg (" \
+                              "src nvarchar(100), channelid nvarchar(255), eventid int, eiteventid int, "\
+                              "starttime datetime, duration int, title nvarchar(255), alttitle nvarchar(255), "\
+                              "origtitle nvarchar(255), shorttext nvarchar(255), description text, "\
+                              "eitdescription text, country nvarchar(255), year int, " \
+                              "credits text, category text, review text, rating text, " \
+                              "starrating text, video text, audio text, season int, episode int, " \
+                              "episodeoverall int, pics text, srcidx int, hash int, epstamp int," \
+                              "PRIMARY KEY(eventid, src, channelid)" \
+                              ");" \
+                              "CREATE INDEX idx1 on epg (starttime, eiteventid, channelid); " \
+                              "CREATE INDEX idx2 on epg (starttime, title, channelid); " \
+                              "CREATE INDEX idx3 on epg (starttime, duration, src);";
+
+// the former cXMLTVEvent::GetSQL, the caller frees the statements
+static void oldgetsql(cXMLTVEvent *Event, const char *Source, int SrcIdx, const char *ChannelID,
+                      char **Insert, char **Update)
+{
+    *Insert=NULL;
+    *Update=NULL;
+
+    long long hash=(long long) Event->Hash(SrcIdx);
+    time_t epstamp=time(NULL);
+
+    const char *cr=Event->Credits()->toString();
+    const char *ca=Event->Category()->toString();
+    const char *re=Event->Review()->toString();
+    const char *ra=Event->Rating()->toString();
+    const char *sr=Event->StarRating()->toString();
+    const char *vi=Event->Video()->toString();
+    const char *pi=Event->Pics()->toString();
+
+    char *sql_insert,*sql_update;
+    if (asprintf(&sql_insert,
+                 "INSERT OR FAIL INTO epg (src,channelid,eventid,starttime,duration,"\
+                 "title,alttitle,origtitle,shorttext,description,country,year,credits,category,"\
+                 "review,rating,starrating,video,audio,season,episode,episodeoverall,pics,srcidx,hash,"\
+                 "epstamp) "\
+                 "VALUES (^%s^,^%s^,%u,%li,%i,"\
+                 "^%s^,^%s^,^%s^,^%s^,^%s^,^%s^,%i,^%s^,^%s^,"\
+                 "^%s^,^%s^,^%s^,^%s^,^%s^,%i,%i,%i,^%s^,%i,%lli,%li);"
+                 ,
+                 Source,ChannelID,Event->EventID(),Event->StartTime(),Event->Duration(),Event->Title(),
+                 Event->AltTitle() ? Event->AltTitle() : "NULL",
+                 Event->OrigTitle() ? Event->OrigTitle() : "NULL",
+                 Event->ShortText() ? Event->ShortText() : "NULL",
+                 Event->Description() ? Event->Description() : "NULL",
+                 Event->Country() ? Event->Country() : "NULL",
+                 Event->Year(),
+                 cr,ca,re,ra,sr,vi,
+                 Event->Audio() ? Event->Audio() : "NULL",
+                 Event->Season(),Event->Episode(),Event->EpisodeOverall(),pi,SrcIdx,hash,epstamp
+                )==-1) return;
+
+    if (asprintf(&sql_update,
+                 "UPDATE epg SET duration=%i,starttime=%li,title=^%s^,alttitle=^%s^,origtitle=^%s^,"\
+                 "shorttext=^%s^,description=^%s^,country=^%s^,year=%i,credits=^%s^,category=^%s^,"\
+                 "review=^%s^,rating=^%s^,starrating=^%s^,video=^%s^,audio=^%s^,season=%i,episode=%i, "\
+                 "episodeoverall=%i,pics=^%s^,srcidx=%i,hash=%lli,epstamp=%li " \
+                 " where src=^%s^ and channelid=^%s^ and eventid=%u"
+                 ,
+                 Event->Duration(),Event->StartTime(),Event->Title(),
+                 Event->AltTitle() ? Event->AltTitle() : "NULL",
+                 Event->OrigTitle() ? Event->OrigTitle() : "NULL",
+                 Event->ShortText() ? Event->ShortText() : "NULL",
+                 Event->Description() ? Event->Description() : "NULL",
+                 Event->Country() ? Event->Country() : "NULL",
+                 Event->Year(),
+                 cr,ca,re,ra,sr,vi,
+                 Event->Audio() ? Event->Audio() : "NULL",
+                 Event->Season(),Event->Episode(),Event->EpisodeOverall(),pi,SrcIdx,hash,epstamp,
+                 Source,ChannelID,Event->EventID()
+                )==-1)
+    {
+        free(sql_insert);
+        return;
+    }
+
+    std::string si=sql_insert;
+    si = std::regex_replace(si, std::regex("'"), "''");
+    si = std::regex_replace(si, std::regex("\\^"), "'");
+    si = std::regex_replace(si, std::regex("'NULL'"), "NULL");
+    sql_insert=(char *) realloc(sql_insert,si.size()+1);
+    strcpy(sql_insert,si.c_str());
+    *Insert=sql_insert;
+
+    std::string su=sql_update;
+    su = std::regex_replace(su, std::regex("'"), "''");
+    su = std::regex_replace(su, std::regex("\\^"), "'");
+    su = std::regex_replace(su, std::regex("'NULL'"), "NULL");
+    sql_update=(char *) realloc(sql_update,su.size()+1);
+    strcpy(sql_update,su.c_str());
+    *Update=sql_update;
+}
+
+// -------------------------------------------------------
+
+static double now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC,&ts);
+    return ts.tv_sec+ts.tv_nsec/1e9;
+}
+
+// without Globals the table of the former statements is created
+static sqlite3 *opendb(cGlobals *Globals)
+{
+    sqlite3 *db;
+    if (sqlite3_open(":memory:",&db)!=SQLITE_OK)
+    {
+        printf("sqltest: cannot open database\n");
+        sqlite3_close(db);
+        return NULL;
+    }
+    bool ok=Globals ? Globals->UpgradeDB(db) : (sqlite3_exec(db,oldschema,NULL,NULL,NULL)==SQLITE_OK);
+    if (!ok)
+    {
+        printf("sqltest: cannot create schema: %s\n",sqlite3_errmsg(db));
+        sqlite3_close(db);
+        return NULL;
+    }
+    return db;
+}
+
+static int store(sqlite3 *Db, sqlite3_stmt *Stmt, cXMLTVEvent *Event, sqlite3_int64 SrcID,
+                 sqlite3_int64 ChID)
+{
+    cXMLTVValues values;
+    Event->GetSQLValues(SrcID,1,&values);
+    values.SetNumber(XMLTVPARAM_CHID,ChID);
+    int ret=values.Bind(Stmt);
+    if (ret==SQLITE_OK) ret=sqlite3_step(Stmt);
+    sqlite3_reset(Stmt);
+    if (ret!=SQLITE_DONE) printf("sqltest: %s\n",sqlite3_errmsg(Db));
+    return ret;
+}
+
+static const char *quirks[]=
+{
+    "Rock'n'Roll",
+    "^Caret^ in ^the^ title",
+    "'^'",
+    "NULL",
+    "'NULL'",
+    "^NULL^",
+    "''",
+    "Ende; DROP TABLE epg; --",
+    "Schräg & „zitiert“",
+    NULL
+};
+
+static int check(cGlobals &Globals)
+{
+    sqlite3 *db=opendb(&Globals);
+    if (!db) return 1;
+    sqlite3_int64 srcid=cXMLTVEvent::SourceKey(db,"test");
+    sqlite3_int64 chid=cXMLTVEvent::ChannelKey(db,"S19.2E-1-1-1");
+    sqlite3_stmt *insert=NULL,*update=NULL,*select=NULL;
+    if ((srcid<0) || (chid<0) ||
+            (sqlite3_prepare_v2(db,cXMLTVEvent::InsertSQL(),-1,&insert,NULL)!=SQLITE_OK) ||
+            (sqlite3_prepare_v2(db,cXMLTVEvent::UpdateSQL(),-1,&update,NULL)!=SQLITE_OK) ||
+            (sqlite3_prepare_v2(db,"SELECT title,shorttext,description,credits,alttitle,endtime FROM epg " \
+                                "WHERE srcid=?1 AND chid=?2 AND eventid=?3",-1,&select,NULL)!=SQLITE_OK))
+    {
+        printf("sqltest: %s\n",sqlite3_errmsg(db));
+        sqlite3_finalize(insert);
+        sqlite3_finalize(update);
+        sqlite3_close(db);
+        return 1;
+    }
+
+    int failed=0,stored=0;
+    for (int pass=0; pass<2; pass++)
+    {
+        for (int i=0; quirks[i]; i++)
+        {
+            // the second pass updates the rows with the texts swapped
+            const char *text=quirks[i];
+            const char *other=quirks[i+1] ? quirks[i+1] : quirks[0];
+            if (pass) std::swap(text,other);
+
+            cXMLTVEvent event;
+            event.SetEventID(1000+i);
+            event.SetStartTime(1719835200+i*3600);
+            event.SetDuration(1800+pass*60);
+            event.SetTitle(text);
+            event.SetShortText(other);
+            event.SetDescription(text);
+            event.AddCredits("actor",text);
+            if (store(db,pass ? update : insert,&event,srcid,chid)!=SQLITE_DONE)
+            {
+                failed++;
+                continue;
+            }
+            stored++;
+
+            char credits[256];
+            snprintf(credits,sizeof(credits),"actor|%s",text);
+            sqlite3_bind_int64(select,1,srcid);
+            sqlite3_bind_int64(select,2,chid);
+            sqlite3_bind_int64(select,3,1000+i);
+            bool ok=(sqlite3_step(select)==SQLITE_ROW);
+            if (ok)
+            {
+                const char *title=(const char *) sqlite3_column_text(select,0);
+                const char *shorttext=(const char *) sqlite3_column_text(select,1);
+                const char *description=(const char *) sqlite3_column_text(select,2);
+                const char *credit=(const char *) sqlite3_column_text(select,3);
+                ok=((title) && (!strcmp(title,text)) && (shorttext) && (!strcmp(shorttext,other)) &&
+                    (description) && (!strcmp(description,text)) && (credit) && (!strcmp(credit,credits)) &&
+                    (sqlite3_column_type(select,4)==SQLITE_NULL) &&
+                    (sqlite3_column_int64(select,5)==event.StartTime()+event.Duration()));
+            }
+            sqlite3_reset(select);
+            if (!ok)
+            {
+                printf("sqltest: '%s'/'%s' not read back as stored (%s)\n",text,other,
+                       pass ? "update" : "insert");
+                failed++;
+            }
+        }
+    }
+    sqlite3_finalize(insert);
+    sqlite3_finalize(update);
+    sqlite3_finalize(select);
+    sqlite3_close(db);
+    printf("sqltest: %i rows stored and read back, %i failed\n",stored,failed);
+    return failed;
+}
+
+static void makeevents(cXMLTVEvent *Events, int Count)
+{
+    // a week of programmes with texts of common length
+    char description[512];
+    for (int i=0; i<Count; i++)
+    {
+        cXMLTVEvent *e=&Events[i];
+        char buf[64];
+        e->SetEventID(1+i/BENCHCHANNELS);
+        e->SetStartTime(1719835200+(i/BENCHCHANNELS)*1800);
+        e->SetDuration(1800);
+        snprintf(buf,sizeof(buf),"Serie %i's \"Titel\"",i%977);
+        e->SetTitle(buf);
+        snprintf(buf,sizeof(buf),"Folge %i: Die Rückkehr",i%31);
+        e->SetShortText(buf);
+        snprintf(description,sizeof(description),"Der Kommissar ermittelt in einem Mordfall, die Spur " \
+                 "führt nach München. Als ihre Tochter %i verschwindet, gerät sie selbst unter " \
+                 "Verdacht. Regie: Max Mustermann, mit Erika Musterfrau und Hans Meier in der " \
+                 "Rolle des Kommissars. Ein Film über die Liebe und den Verrat, gedreht in " \
+                 "Österreich und Bayern im Sommer des Jahres 2012.",i);
+        e->SetDescription(description);
+        e->SetCountry("D");
+        e->SetYear(2012);
+        e->AddCredits("director","Max Mustermann");
+        e->AddCredits("actor","Erika Musterfrau");
+        e->AddCredits("actor","Hans Meier");
+        e->AddCategory("Krimi");
+        e->AddVideo("aspect","16:9");
+        e->SetSeason(1+i%5);
+        e->SetEpisode(1+i%31);
+    }
+}
+
+static double benchformer(cXMLTVEvent *Events, int Count, bool Update)
+{
+    sqlite3 *db=opendb(NULL);
+    if (!db) return 0;
+    sqlite3_exec(db,"BEGIN",NULL,NULL,NULL);
+    double start=now();
+    for (int pass=Update ? 0 : 1; pass<2; pass++)
+    {
+        if (pass) start=now();
+        for (int i=0; i<Count; i++)
+        {
+            char channelid[32],*isql,*usql;
+            snprintf(channelid,sizeof(channelid),"S19.2E-1-1-%i",i%BENCHCHANNELS);
+            oldgetsql(&Events[i],"test",1,channelid,&isql,&usql);
+            if ((!isql) || (!usql)) continue;
+            // on updates the former code knew the row from its fingerprint
+            if (sqlite3_exec(db,pass && Update ? usql : isql,NULL,NULL,NULL)!=SQLITE_OK)
+                printf("sqltest: %s\n",sqlite3_errmsg(db));
+            free(isql);
+            free(usql);
+        }
+    }
+    double t=now()-start;
+    sqlite3_exec(db,"COMMIT",NULL,NULL,NULL);
+    sqlite3_close(db);
+    return t;
+}
+
+static double benchprepared(cGlobals &Globals, cXMLTVEvent *Events, int Count, bool Update)
+{
+    sqlite3 *db=opendb(&Globals);
+    if (!db) return 0;
+    sqlite3_exec(db,"BEGIN",NULL,NULL,NULL);
+    sqlite3_int64 srcid=cXMLTVEvent::SourceKey(db,"test");
+    sqlite3_int64 chids[BENCHCHANNELS];
+    for (int i=0; i<BENCHCHANNELS; i++)
+    {
+        char channelid[32];
+        snprintf(channelid,sizeof(channelid),"S19.2E-1-1-%i",i);
+        chids[i]=cXMLTVEvent::ChannelKey(db,channelid);
+    }
+    sqlite3_stmt *insert=NULL,*update=NULL;
+    sqlite3_prepare_v2(db,cXMLTVEvent::InsertSQL(),-1,&insert,NULL);
+    sqlite3_prepare_v2(db,cXMLTVEvent::UpdateSQL(),-1,&update,NULL);
+    double start=now();
+    for (int pass=Update ? 0 : 1; pass<2; pass++)
+    {
+        if (pass) start=now();
+        for (int i=0; i<Count; i++)
+            store(db,pass && Update ? update : insert,&Events[i],srcid,chids[i%BENCHCHANNELS]);
+    }
+    double t=now()-start;
+    sqlite3_finalize(insert);
+    sqlite3_finalize(update);
+    sqlite3_exec(db,"COMMIT",NULL,NULL,NULL);
+    sqlite3_close(db);
+    return t;
+}
+
+static void bench(cGlobals &Globals)
+{
+    cXMLTVEvent *events=new cXMLTVEvent[BENCHROWS];
+    makeevents(events,BENCHROWS);
+    for (int update=0; update<=1; update++)
+    {
+        double newtime=benchprepared(Globals,events,BENCHROWS,update);
+        double oldtime=benchformer(events,BENCHROWS,update);
+        printf("sqltest: %i %-7s prepared %9.0f rows/s, former %9.0f rows/s, %.1fx\n",BENCHROWS,
+               update ? "updates" : "inserts",BENCHROWS/newtime,BENCHROWS/oldtime,oldtime/newtime);
+    }
+    delete [] events;
+}
+
+int main(int argc, char *argv[])
+{
+    cGlobals globals;
+    if ((argc>1) && (!strcmp(argv[1],"-b")))
+    {
+        bench(globals);
+        return 0;
+    }
+    return check(globals) ? 1 : 0;
+}
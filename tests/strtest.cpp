@@ -0,0 +1,387 @@
+/*
+ * strtest.cpp: A plugin for the Video Disk Recorder
+ *
+ * See the README file for copyright information and how to reach the author.
+ *
+ */
+
+// Compares cParse::RemoveNonAlphaNumeric and cImport::RemoveNonASCII
+// with the former implementations on a generated corpus, plus the lines
+// of all files given on the command line (e.g. eplists files). With -b
+// both versions are timed on short texts and on long descriptions.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <time.h>
+
+#include "parse.h"
+#include "import.h"
+
+#define SLACK 64
+
+// the former implementation. The " Teil " removal moves len-6 bytes
+// from behind the marker, so it needs len bytes of slack behind the
+// string
+static void oldremovenonalphanumeric(char *String, bool InDescription)
+{
+    if (!String) return;
+
+    // remove " Teil " (special for .episodes files)
+    int len=strlen(String);
+    char *p=strstr(String," Teil ");
+    if (!p) p=strstr(String,"(Teil ");
+    if (p)
+    {
+        memmove(p,p+6,len-6);
+    }
+
+    // cut off " Dramedy,"
+    p=strstr(String," Dramedy,");
+    if (p) *p=0;
+
+    // cut off " Krimi,"
+    p=strstr(String," Krimi,");
+    if (p) *p=0;
+
+    // cut off " Familie,"
+    p=strstr(String," Familie,");
+    if (p) *p=0;
+
+    // cut off " Western,"
+    p=strstr(String," Western,");
+    if (p) *p=0;
+
+    // cut off " Folge XX" at end
+    p=strstr(String," Folge ");
+    if (p) *p=0;
+
+    bool bCutNumbers=false;
+    len=strlen(String);
+    p=String;
+    // cut off "Folge XX" at start
+    if (!strncmp(String,"Folge ",6))
+    {
+        memmove(p,p+6,len-6);
+        String[len-6]=0;
+        bCutNumbers=true;
+    }
+
+    if (InDescription || bCutNumbers)
+    {
+        // remove leading numbers (inkl. roman numerals)
+        len=strlen(String);
+        p=String;
+        while (*p)
+        {
+            if (((*p>=0x30) && (*p<=0x39)) || (*p=='I') || (*p=='V') || (*p=='X') || (*p=='/'))
+            {
+                memmove(p,p+1,len);
+                len--;
+                continue;
+            }
+            else
+            {
+                break;
+            }
+        }
+    }
+
+    // remove non alphanumeric characters
+    len=strlen(String);
+    p=String;
+    int pos=0;
+    while (*p)
+    {
+        if ((*p<0x30) || (*p>0x7a) || (*p>0x39 && *p<0x41) || (*p>0x5A && *p< 0x61))
+        {
+            memmove(p,p+1,len-pos);
+            len--;
+            continue;
+        }
+        if ((*p=='i') && (*(p+1) && *(p+1)=='e'))
+        {
+            memmove(p,p+1,len-pos);
+            len--;
+            *p='y';
+            continue;
+        }
+        p++;
+        pos++;
+    }
+}
+
+static char *oldremovenonascii(const char *src)
+{
+    if (!src) return NULL;
+    int len=strlen(src);
+    if (!len) return NULL;
+    char *dst=(char *) malloc(len+1);
+    if (!dst) return NULL;
+    char *tmp=dst;
+    bool lspc=false;
+    while (*src)
+    {
+        if ((*src==0x20) && (!lspc))
+        {
+            *tmp++=0x20;
+            lspc=true;
+        }
+        if (*src==':')
+        {
+            *tmp++=0x20;
+            lspc=true;
+        }
+        if ((*src>=0x30) && (*src<=0x39))
+        {
+            *tmp++=*src;
+            lspc=false;
+        }
+        if ((*src>=0x41) && (*src<=0x5A))
+        {
+            *tmp++=tolower(*src);
+            lspc=false;
+        }
+        if ((*src>=0x61) && (*src<=0x7A))
+        {
+            *tmp++=*src;
+            lspc=false;
+        }
+        src++;
+    }
+    *tmp=0;
+    return dst;
+}
+
+// -------------------------------------------------------
+
+static const char *quirks[]=
+{
+    "",
+    "Folge 12: Die Rückkehr",
+    "Folge XII - Viel Lärm um nichts",
+    "Folge IV/2 Liebe",
+    "Folge 3/4",
+    "Folge ",
+    "Folge",
+    "Die Serie Folge 12",
+    "Die Serie, Folge 12",
+    "Teil 2",
+    "Der Pate Teil 2",
+    " Teil 3 vom Ende",
+    "(Teil 2)",
+    "Die Wiese (Teil 2) Folge 3",
+    "Liebe Dramedy, USA 2010",
+    "Tatort Krimi, D 2012 Folge 5",
+    "Western, Familie, Krimi,",
+    "Ein Krimi, ein Western, eine Familie,",
+    " Dramedy, Krimi, Familie, Western, Folge ",
+    "Die Wiener Spiele",
+    "Sie sieht die Brie-Diebe",
+    "iiee ieie eiei",
+    "XIV Zwischenfälle",
+    "2 Freunde",
+    "VIVA Las Vegas",
+    "Gänseblümchen, Äpfel & Öl für 5 €",
+    "Señor Müller: Ça va?",
+    "\t\ttabs\r\nund zeilen",
+    "100% ~ [Klammer] {geschweift} \\ ^ _ `",
+    // "ie" across blocks of 16 characters
+    "ABCDEFGHIJKLMNOiePQRSTUVWXYZ0123456789",
+    "ABCDEFGHIJKLMNieOPQRSTUVWXYZ0123456789",
+    "A-C-E-G-I-K-M-OieQ-S-U-W-Y-0-2-4-6-8-",
+    "ieieieieieieieieieieieieieieieieieieie",
+    NULL
+};
+
+static const char *words[]=
+{
+    "Die","Der","Tatort","Serie","Wiener","Liebe","die","Spiel","sieht","Brie","Diebe","Wiese",
+    "Folge","Teil","(Teil","Dramedy,","Krimi,","Familie,","Western,","I","II","III","IV","XII",
+    "V","X","12","3/4","/","1.","Ärger","Öl","ße","été","-",":","'",",","(",")","!","&","ie","e"
+};
+
+// texts like in real descriptions, without the cut markers
+static const char *prose[]=
+{
+    "Der","Kommissar","ermittelt","in","einem","Mordfall,","die","Spur","führt","nach","München.",
+    "Als","ihre","Tochter","verschwindet,","gerät","sie","selbst","unter","Verdacht","–","\"Tatort\"",
+    "(2012)","Regie:","Schauspieler","Österreich","spielen","Rolle","großen","Familie","Liebe"
+};
+
+static char *randomtext(const char **Vocabulary, int Size, int Words)
+{
+    char *text=(char *) malloc(Words*16+SLACK);
+    if (!text) return NULL;
+    char *p=text;
+    if (rand()%4==0)
+    {
+        strcpy(p,"Folge ");
+        p+=6;
+    }
+    for (int i=0; i<Words; i++)
+    {
+        const char *w=Vocabulary[rand()%Size];
+        strcpy(p,w);
+        p+=strlen(w);
+        if (rand()%8) *p++=' ';
+    }
+    *p=0;
+    return text;
+}
+
+class cCorpus
+{
+private:
+    cVector<char *> texts;
+public:
+    ~cCorpus()
+    {
+        for (int i=0; i<texts.Size(); i++) free(texts[i]);
+    }
+    void Add(char *Text)
+    {
+        if (Text) texts.Append(Text);
+    }
+    int Size()
+    {
+        return texts.Size();
+    }
+    const char *Get(int Index)
+    {
+        return texts[Index];
+    }
+    bool ReadFile(const char *FileName)
+    {
+        FILE *f=fopen(FileName,"r");
+        if (!f) return false;
+        char *line=NULL;
+        size_t size=0;
+        ssize_t len;
+        while ((len=getline(&line,&size,f))!=-1)
+        {
+            if ((len) && (line[len-1]=='\n')) line[--len]=0;
+            Add(strdup(line));
+        }
+        free(line);
+        fclose(f);
+        return true;
+    }
+};
+
+static double now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC,&ts);
+    return ts.tv_sec+ts.tv_nsec/1e9;
+}
+
+static int compare(cCorpus &Corpus)
+{
+    int failed=0;
+    for (int i=0; i<Corpus.Size(); i++)
+    {
+        const char *text=Corpus.Get(i);
+        size_t len=strlen(text);
+        for (int desc=0; desc<=1; desc++)
+        {
+            // zeroed slack behind the former copy, the former code
+            // moves bytes from there into the string
+            char *o=(char *) calloc(1,2*len+SLACK);
+            char *n=(char *) calloc(1,len+1);
+            if ((!o) || (!n)) return failed+1;
+            memcpy(o,text,len);
+            memcpy(n,text,len);
+            oldremovenonalphanumeric(o,desc);
+            cParse::RemoveNonAlphaNumeric(n,desc);
+            if (strcmp(o,n))
+            {
+                if (failed<10) printf("strtest: RemoveNonAlphaNumeric('%s',%s) is '%s', former '%s'\n",
+                                          text,desc ? "true" : "false",n,o);
+                failed++;
+            }
+            free(o);
+            free(n);
+        }
+        char *o=oldremovenonascii(text);
+        char *n=cImport::RemoveNonASCII(text);
+        if ((!o!=!n) || ((o) && (strcmp(o,n))))
+        {
+            if (failed<10) printf("strtest: RemoveNonASCII('%s') is '%s', former '%s'\n",
+                                      text,n ? n : "(null)",o ? o : "(null)");
+            failed++;
+        }
+        free(o);
+        free(n);
+    }
+    return failed;
+}
+
+static void bench(const char *Name, int Count, int Words)
+{
+    cCorpus corpus;
+    for (int i=0; i<Count; i++) corpus.Add(randomtext(prose,sizeof(prose)/sizeof(prose[0]),Words));
+    size_t maxlen=0;
+    for (int i=0; i<corpus.Size(); i++)
+    {
+        size_t len=strlen(corpus.Get(i));
+        if (len>maxlen) maxlen=len;
+    }
+    char *buf=(char *) calloc(1,2*maxlen+SLACK);
+    if (!buf) return;
+
+    double start=now();
+    for (int i=0; i<corpus.Size(); i++)
+    {
+        strcpy(buf,corpus.Get(i));
+        cParse::RemoveNonAlphaNumeric(buf,true);
+    }
+    double newtime=now()-start;
+    start=now();
+    for (int i=0; i<corpus.Size(); i++)
+    {
+        strcpy(buf,corpus.Get(i));
+        oldremovenonalphanumeric(buf,true);
+    }
+    double oldtime=now()-start;
+    printf("strtest: RemoveNonAlphaNumeric %6i %-12s new %7.3fs, former %7.3fs, %.1fx\n",
+           corpus.Size(),Name,newtime,oldtime,oldtime/newtime);
+
+    start=now();
+    for (int i=0; i<corpus.Size(); i++) free(cImport::RemoveNonASCII(corpus.Get(i)));
+    newtime=now()-start;
+    start=now();
+    for (int i=0; i<corpus.Size(); i++) free(oldremovenonascii(corpus.Get(i)));
+    oldtime=now()-start;
+    printf("strtest: RemoveNonASCII        %6i %-12s new %7.3fs, former %7.3fs, %.1fx\n",
+           corpus.Size(),Name,newtime,oldtime,oldtime/newtime);
+    free(buf);
+}
+
+int main(int argc, char *argv[])
+{
+    if ((argc>1) && (!strcmp(argv[1],"-b")))
+    {
+        srand(1);
+        bench("shorttexts",200000,5);
+        bench("descriptions",10000,300);
+        return 0;
+    }
+
+    cCorpus corpus;
+    for (int i=0; quirks[i]; i++) corpus.Add(strdup(quirks[i]));
+    srand(1);
+    for (int i=0; i<100000; i++) corpus.Add(randomtext(words,sizeof(words)/sizeof(words[0]),1+rand()%(i%100 ? 12 : 400)));
+    for (int i=1; i<argc; i++)
+    {
+        if (!corpus.ReadFile(argv[i]))
+        {
+            printf("strtest: cannot read '%s'\n",argv[i]);
+            return 1;
+        }
+    }
+    int failed=compare(corpus);
+    printf("strtest: %i texts compared, %i failed\n",corpus.Size(),failed);
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,241 @@
+/*
+ * tztest.cpp: A plugin for the Video Disk Recorder
+ *
+ * See the README file for copyright information and how to reach the author.
+ *
+ */
+
+// Checks cXMLTVZones::ConvertXMLTVTime2UnixTime against known values
+// and against the former TZ/mktime based conversion. With -b both are
+// timed over a million timestamps.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "tz.h"
+
+#define BENCHCOUNT 1000000
+
+// the former conversion. It set TZ for each call and used tm_isdst=0,
+// so named zones were one hour off in summer. With IsDST=-1 mktime
+// decides on DST, that's what the new code has to match
+static time_t oldconvert(const char *XMLTVTime, int IsDST=0)
+{
+    char xmltvtime[64];
+    if (!XMLTVTime) return (time_t) 0;
+    strn0cpy(xmltvtime,XMLTVTime,sizeof(xmltvtime));
+
+    time_t offset=0;
+    char *withtz=strchr(xmltvtime,' ');
+    int len;
+    if (withtz)
+    {
+        len=strlen(xmltvtime)-(withtz-xmltvtime)-1;
+        *withtz=':';
+        if ((withtz[1]=='+') || (withtz[1]=='-'))
+        {
+            if (len==5)
+            {
+                int val=atoi(&withtz[1]);
+                int h=val/100;
+                int m=val-(h*100);
+                offset=h*3600+m*60;
+                setenv("TZ",":UTC",1);
+            }
+            else
+            {
+                setenv("TZ",":UTC",1);
+            }
+        }
+        else
+        {
+            if (len>2)
+            {
+                setenv("TZ",withtz,1);
+            }
+            else
+            {
+                setenv("TZ",":UTC",1);
+            }
+        }
+    }
+    else
+    {
+        withtz=&xmltvtime[strlen(xmltvtime)];
+        setenv("TZ",":UTC",1);
+    }
+    tzset();
+
+    len=withtz-xmltvtime;
+    if (len<4)
+    {
+        unsetenv("TZ");
+        tzset();
+        return (time_t) 0;
+    }
+    len-=2;
+    char fmt[]="%Y%m%d%H%M%S";
+    fmt[len]=0;
+
+    struct tm tm;
+    memset(&tm,0,sizeof(tm));
+    if (!strptime(xmltvtime,fmt,&tm))
+    {
+        unsetenv("TZ");
+        tzset();
+        return (time_t) 0;
+    }
+    if (tm.tm_mday==0) tm.tm_mday=1;
+    tm.tm_isdst=IsDST;
+    time_t ret=mktime(&tm);
+    ret-=offset;
+    unsetenv("TZ");
+    tzset();
+    return ret;
+}
+
+// true if the local time exists exactly once in the zone, local times
+// in a DST gap or overlap are resolved differently by mktime
+static bool unique(const char *Zone, int Year, int Month, int Day, int Hour, int Min)
+{
+    char tz[64];
+    snprintf(tz,sizeof(tz),":%s",Zone);
+    setenv("TZ",tz,1);
+    tzset();
+    int valid=0;
+    for (int dst=0; dst<=1; dst++)
+    {
+        struct tm tm;
+        memset(&tm,0,sizeof(tm));
+        tm.tm_year=Year-1900;
+        tm.tm_mon=Month-1;
+        tm.tm_mday=Day;
+        tm.tm_hour=Hour;
+        tm.tm_min=Min;
+        tm.tm_isdst=dst;
+        time_t t=mktime(&tm);
+        struct tm lt;
+        localtime_r(&t,&lt);
+        if ((lt.tm_isdst==dst) && (lt.tm_hour==Hour) && (lt.tm_min==Min) && (lt.tm_mday==Day)) valid++;
+    }
+    unsetenv("TZ");
+    tzset();
+    return (valid==1);
+}
+
+static double now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC,&ts);
+    return ts.tv_sec+ts.tv_nsec/1e9;
+}
+
+static int check(cXMLTVZones &Zones)
+{
+    static const struct
+    {
+        const char *xmltvtime;
+        time_t expected;
+    } known[]=
+    {
+        { "20240701120000 +0200", 1719828000 },
+        { "20240101000000 -0530", 1704087000 },
+        { "20240701120000", 1719835200 },
+        { "202407011200", 1719835200 },
+        { "202407", 1719792000 },
+        { "20240331013000 Europe/Berlin", 1711845000 },
+        { "20240331033000 Europe/Berlin", 1711848600 },
+        // in the overlap the later time is used
+        { "20241027023000 Europe/Berlin", 1729992600 },
+        { "20240701120000 America/New_York", 1719849600 },
+        // unknown zones are UTC
+        { "20240701120000 Foo/Bar", 1719835200 },
+        { "20241301000000 +0100", 0 },
+        { "2024", 1704067200 },
+        { "202", 0 },
+        { "", 0 },
+        { NULL, 0 }
+    };
+
+    int failed=0;
+    for (int i=0; known[i].xmltvtime; i++)
+    {
+        time_t t=Zones.ConvertXMLTVTime2UnixTime(known[i].xmltvtime);
+        if (t!=known[i].expected)
+        {
+            printf("tztest: '%s' is %li, expected %li\n",known[i].xmltvtime,(long) t,
+                   (long) known[i].expected);
+            failed++;
+        }
+    }
+
+    static const char *zones[]=
+    {
+        "+0100","+0200","-0530","+0000","+01","",
+        "Europe/Berlin","Europe/London","America/New_York","Australia/Sydney","Asia/Kolkata","UTC"
+    };
+    int nzones=sizeof(zones)/sizeof(zones[0]);
+    srand(1);
+    int compared=0,skipped=0;
+    for (int i=0; i<200000; i++)
+    {
+        int year=1990+rand()%50,month=1+rand()%12,day=1+rand()%28;
+        int hour=rand()%24,min=rand()%60,sec=rand()%60;
+        const char *zone=zones[rand()%nzones];
+        char xmltvtime[64];
+        snprintf(xmltvtime,sizeof(xmltvtime),"%04i%02i%02i%02i%02i%02i%s%s",year,month,day,hour,min,sec,
+                 *zone ? " " : "",zone);
+        bool named=((*zone) && (*zone!='+') && (*zone!='-'));
+        if ((named) && (!unique(zone,year,month,day,hour,min)))
+        {
+            skipped++;
+            continue;
+        }
+        time_t t=Zones.ConvertXMLTVTime2UnixTime(xmltvtime);
+        time_t o=oldconvert(xmltvtime,named ? -1 : 0);
+        compared++;
+        if (t!=o)
+        {
+            if (failed<10) printf("tztest: '%s' is %li, former conversion %li\n",xmltvtime,(long) t,(long) o);
+            failed++;
+        }
+    }
+    printf("tztest: %i timestamps compared, %i in DST gaps/overlaps skipped, %i failed\n",
+           compared,skipped,failed);
+    return failed;
+}
+
+static void bench(cXMLTVZones &Zones, const char *Name, const char *Zone)
+{
+    // a week of programmes every 30 minutes, repeated
+    static char xmltvtimes[336][64];
+    for (int i=0; i<336; i++)
+    {
+        int day=1+i/48,hour=(i%48)/2,min=(i%2)*30;
+        snprintf(xmltvtimes[i],sizeof(xmltvtimes[i]),"202407%02i%02i%02i00 %s",day,hour,min,Zone);
+    }
+
+    volatile time_t sum=0;
+    double start=now();
+    for (int i=0; i<BENCHCOUNT; i++) sum+=Zones.ConvertXMLTVTime2UnixTime(xmltvtimes[i%336]);
+    double newtime=now()-start;
+    start=now();
+    for (int i=0; i<BENCHCOUNT; i++) sum+=oldconvert(xmltvtimes[i%336]);
+    double oldtime=now()-start;
+    printf("tztest: %i timestamps %-14s new %7.3fs (%6.1f ns each), former %7.3fs (%6.1f ns each), %.0fx\n",
+           BENCHCOUNT,Name,newtime,newtime*1e9/BENCHCOUNT,oldtime,oldtime*1e9/BENCHCOUNT,oldtime/newtime);
+}
+
+int main(int argc, char *argv[])
+{
+    cXMLTVZones zones;
+    if ((argc>1) && (!strcmp(argv[1],"-b")))
+    {
+        bench(zones,"with offset","+0200");
+        bench(zones,"with zone name","Europe/Berlin");
+        return 0;
+    }
+    return check(zones) ? 1 : 0;
+}
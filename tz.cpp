@@ -0,0 +1,431 @@
+/*
+ * tz.cpp: A plugin for the Video Disk Recorder
+ *
+ * See the README file for copyright information and how to reach the author.
+ *
+ */
+
+#include <string.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "xmltv2vdr.h"
+#include "tz.h"
+#include "debug.h"
+
+long DaysFromCivil(int Year, int Month, int Day)
+{
+    Year-=(Month<=2);
+    long era=(Year>=0 ? Year : Year-399)/400;
+    long yoe=Year-era*400;
+    long doy=(153*(Month+(Month>2 ? -3 : 9))+2)/5+Day-1;
+    long doe=yoe*365+yoe/4-yoe/100+doy;
+    return era*146097+doe-719468;
+}
+
+static int YearFromDays(long Days)
+{
+    int year=1970+(int) (Days/366);
+    while (DaysFromCivil(year+1,1,1)<=Days) year++;
+    while (DaysFromCivil(year,1,1)>Days) year--;
+    return year;
+}
+
+static int32_t be32(const unsigned char *p)
+{
+    return (int32_t) (((uint32_t) p[0]<<24) | ((uint32_t) p[1]<<16) | ((uint32_t) p[2]<<8) | (uint32_t) p[3]);
+}
+
+static int64_t be64(const unsigned char *p)
+{
+    return (int64_t) (((uint64_t) (uint32_t) be32(p)<<32) | (uint64_t) (uint32_t) be32(p+4));
+}
+
+// -------------------------------------------------------
+
+cXMLTVZone::cXMLTVZone(const char *Name)
+{
+    name=strdup(Name);
+    timecnt=0;
+    typecnt=0;
+    transitions=NULL;
+    idxs=NULL;
+    utoffs=NULL;
+    hasfooter=false;
+    hasdst=false;
+    stdoff=dstoff=0;
+    memset(&start,0,sizeof(start));
+    memset(&end,0,sizeof(end));
+    if (!load())
+    {
+        isyslog("unknown timezone '%s', using UTC",Name);
+    }
+}
+
+cXMLTVZone::~cXMLTVZone()
+{
+    free(name);
+    free(transitions);
+    free(idxs);
+    free(utoffs);
+}
+
+static bool parsename(const char *&s)
+{
+    const char *b=s;
+    if (*s=='<')
+    {
+        const char *e=strchr(s,'>');
+        if (!e) return false;
+        s=e+1;
+        return (e-b>1);
+    }
+    while (isalpha(*s)) s++;
+    return (s-b>=3);
+}
+
+static bool parseoffset(const char *&s, int &Offset)
+{
+    int sign=1;
+    if ((*s=='+') || (*s=='-'))
+    {
+        if (*s=='-') sign=-1;
+        s++;
+    }
+    if (!isdigit(*s)) return false;
+    int val[3]= { 0,0,0 };
+    for (int i=0; i<3; i++)
+    {
+        while (isdigit(*s)) val[i]=val[i]*10+(*s++-'0');
+        if ((i<2) && (*s==':') && (isdigit(s[1])))
+            s++;
+        else
+            break;
+    }
+    Offset=sign*(val[0]*3600+val[1]*60+val[2]);
+    return true;
+}
+
+static bool parserule(const char *&s, int &Type, int &Month, int &Week, int &Day, int &Time)
+{
+    if (*s!=',') return false;
+    s++;
+    Month=Week=Day=0;
+    if (*s=='J')
+    {
+        Type='J';
+        s++;
+        Day=strtol(s,(char **) &s,10);
+    }
+    else if (*s=='M')
+    {
+        Type='M';
+        s++;
+        Month=strtol(s,(char **) &s,10);
+        if (*s++!='.') return false;
+        Week=strtol(s,(char **) &s,10);
+        if (*s++!='.') return false;
+        Day=strtol(s,(char **) &s,10);
+        if ((Month<1) || (Month>12) || (Week<1) || (Week>5) || (Day<0) || (Day>6)) return false;
+    }
+    else if (isdigit(*s))
+    {
+        Type='D';
+        Day=strtol(s,(char **) &s,10);
+    }
+    else
+    {
+        return false;
+    }
+    Time=7200;
+    if (*s=='/')
+    {
+        s++;
+        if (!parseoffset(s,Time)) return false;
+    }
+    return true;
+}
+
+bool cXMLTVZone::parsefooter(const char *footer)
+{
+    // POSIX TZ string, e.g. "CET-1CEST,M3.5.0,M10.5.0/3"
+    const char *s=footer;
+    int off;
+    if (!parsename(s)) return false;
+    if (!parseoffset(s,off)) return false;
+    stdoff=-off;
+    dstoff=stdoff;
+    if (*s)
+    {
+        if (!parsename(s)) return false;
+        dstoff=stdoff+3600;
+        if ((*s) && (*s!=','))
+        {
+            if (!parseoffset(s,off)) return false;
+            dstoff=-off;
+        }
+        if (*s)
+        {
+            if (!parserule(s,start.type,start.month,start.week,start.day,start.time)) return false;
+            if (!parserule(s,end.type,end.month,end.week,end.day,end.time)) return false;
+        }
+        else
+        {
+            // no rules given, same default as glibc
+            start.type=end.type='M';
+            start.month=3;
+            start.week=2;
+            end.month=11;
+            end.week=1;
+            start.day=end.day=0;
+            start.time=end.time=7200;
+        }
+        hasdst=true;
+    }
+    hasfooter=true;
+    return true;
+}
+
+bool cXMLTVZone::load()
+{
+    if ((!name[0]) || (name[0]=='/') || (strstr(name,".."))) return false;
+
+    char *fname=NULL;
+    if (asprintf(&fname,"%s/%s",ZONEINFO,name)==-1) return false;
+    int fd=open(fname,O_RDONLY);
+    free(fname);
+    if (fd==-1) return false;
+
+    struct stat statbuf;
+    if ((fstat(fd,&statbuf)==-1) || (statbuf.st_size<44) || (statbuf.st_size>1048576))
+    {
+        close(fd);
+        return false;
+    }
+    size_t size=statbuf.st_size;
+    unsigned char *buf=(unsigned char *) malloc(size+1);
+    if (!buf)
+    {
+        close(fd);
+        return false;
+    }
+    if (read(fd,buf,size)!=(ssize_t) size)
+    {
+        free(buf);
+        close(fd);
+        return false;
+    }
+    close(fd);
+    buf[size]=0;
+
+    // see RFC 8536 for the TZif format
+    unsigned char *p=buf;
+    int tsize=4;
+    if (memcmp(p,"TZif",4))
+    {
+        free(buf);
+        return false;
+    }
+    for (int pass=0; pass<2; pass++)
+    {
+        if ((size_t) (p-buf)+44>size) break;
+        if (memcmp(p,"TZif",4)) break;
+        int version=p[4];
+        size_t isutcnt=be32(p+20),isstdcnt=be32(p+24),leapcnt=be32(p+28);
+        size_t tcnt=be32(p+32),tycnt=be32(p+36),charcnt=be32(p+40);
+        size_t dsize=tcnt*tsize+tcnt+tycnt*6+charcnt+leapcnt*(tsize+4)+isstdcnt+isutcnt;
+        if ((tycnt<1) || (tycnt>256) || (tcnt>65536) || ((size_t) (p-buf)+44+dsize>size)) break;
+        if ((!pass) && (version>='2'))
+        {
+            // skip the 32bit data, use the 64bit block
+            p+=44+dsize;
+            tsize=8;
+            continue;
+        }
+        unsigned char *d=p+44;
+        transitions=(int64_t *) malloc(tcnt*sizeof(int64_t)+1);
+        idxs=(unsigned char *) malloc(tcnt+1);
+        utoffs=(int *) malloc(tycnt*sizeof(int));
+        if ((!transitions) || (!idxs) || (!utoffs)) break;
+        for (size_t i=0; i<tcnt; i++)
+        {
+            transitions[i]=(tsize==8) ? be64(d) : be32(d);
+            d+=tsize;
+        }
+        memcpy(idxs,d,tcnt);
+        d+=tcnt;
+        for (size_t i=0; i<tycnt; i++)
+        {
+            utoffs[i]=be32(d);
+            d+=6;
+        }
+        for (size_t i=0; i<tcnt; i++)
+        {
+            if (idxs[i]>=tycnt) idxs[i]=0;
+        }
+        timecnt=tcnt;
+        typecnt=tycnt;
+        if (tsize==8)
+        {
+            char *footer=(char *) p+44+dsize;
+            if (*footer=='\n')
+            {
+                footer++;
+                char *lf=strchr(footer,'\n');
+                if (lf)
+                {
+                    *lf=0;
+                    if ((*footer) && (!parsefooter(footer))) hasfooter=false;
+                }
+            }
+        }
+        break;
+    }
+    free(buf);
+    return (typecnt>0);
+}
+
+time_t cXMLTVZone::ruletime(const struct rule *r, int year, int offset)
+{
+    long days=DaysFromCivil(year,1,1);
+    switch (r->type)
+    {
+    case 'J':
+        days+=r->day-1;
+        if ((r->day>=60) && (DaysFromCivil(year,3,1)-DaysFromCivil(year,2,1)==29)) days++;
+        break;
+    case 'D':
+        days+=r->day;
+        break;
+    default:
+    {
+        long first=DaysFromCivil(year,r->month,1);
+        long dim=DaysFromCivil(r->month==12 ? year+1 : year,r->month==12 ? 1 : r->month+1,1)-first;
+        int wday=(int) (((first%7)+7+4)%7); // 1970-01-01 was a thursday
+        int day=((r->day-wday+7)%7)+(r->week-1)*7;
+        while (day>=dim) day-=7;
+        days=first+day;
+        break;
+    }
+    }
+    return (time_t) days*86400+r->time-offset;
+}
+
+int cXMLTVZone::utoff(time_t utc)
+{
+    if (!typecnt)
+    {
+        if (!hasfooter) return 0;
+    }
+    else
+    {
+        if ((!timecnt) || (utc<transitions[0]))
+        {
+            if ((timecnt) || (!hasfooter)) return utoffs[0];
+        }
+        else
+        {
+            int lo=0,hi=timecnt-1;
+            while (lo<hi)
+            {
+                int mid=(lo+hi+1)/2;
+                if (transitions[mid]<=utc)
+                    lo=mid;
+                else
+                    hi=mid-1;
+            }
+            if ((lo<timecnt-1) || (!hasfooter)) return utoffs[idxs[lo]];
+        }
+    }
+    if (!hasdst) return stdoff;
+    int year=YearFromDays((long) ((utc+stdoff)/86400-((utc+stdoff)%86400<0)));
+    time_t s=ruletime(&start,year,stdoff);
+    time_t e=ruletime(&end,year,dstoff);
+    if (s<e)
+        return ((utc>=s) && (utc<e)) ? dstoff : stdoff;
+    else
+        return ((utc>=e) && (utc<s)) ? stdoff : dstoff;
+}
+
+time_t cXMLTVZone::LocalToUTC(time_t Local)
+{
+    // check the offsets valid around the given time, in a gap or an
+    // overlap the later time is used (like mktime does)
+    time_t utc=0,guess=0;
+    bool found=false;
+    for (int i=-1; i<=1; i++)
+    {
+        time_t t=Local-utoff(Local+i*86400);
+        if ((i==-1) || (t>guess)) guess=t;
+        if ((utoff(t)==Local-t) && ((!found) || (t>utc)))
+        {
+            utc=t;
+            found=true;
+        }
+    }
+    return found ? utc : guess;
+}
+
+// -------------------------------------------------------
+
+time_t cXMLTVZones::LocalToUTC(const char *Name, time_t Local)
+{
+    for (cXMLTVZone *zone=First(); zone; zone=Next(zone))
+    {
+        if (!strcmp(zone->Name(),Name)) return zone->LocalToUTC(Local);
+    }
+    cXMLTVZone *zone=new cXMLTVZone(Name);
+    if (!zone) return Local;
+    Add(zone);
+    return zone->LocalToUTC(Local);
+}
+
+time_t cXMLTVZones::ConvertXMLTVTime2UnixTime(const char *xmltvtime)
+{
+    // YYYYMMDDhhmmss with an optional timezone "+hhmm", "-hhmm" or a
+    // zone name, trailing date fields may be omitted
+    if (!xmltvtime) return (time_t) 0;
+    const char *withtz=strchr(xmltvtime,' ');
+    int len=withtz ? withtz-xmltvtime : strlen(xmltvtime);
+    if (len<4) return (time_t) 0;
+
+    static const int width[6]= { 4,2,2,2,2,2 };
+    int val[6]= { 0,1,1,0,0,0 };
+    int fields=(len-2)/2;
+    if (fields>6) fields=6;
+    const char *p=xmltvtime;
+    for (int i=0; i<fields; i++)
+    {
+        int v=0;
+        for (int w=0; w<width[i]; w++, p++)
+        {
+            if ((*p<'0') || (*p>'9')) return (time_t) 0;
+            v=v*10+(*p-'0');
+        }
+        val[i]=v;
+    }
+    if ((val[1]<1) || (val[1]>12) || (val[2]<1) || (val[2]>31) ||
+            (val[3]>23) || (val[4]>59) || (val[5]>61)) return (time_t) 0;
+
+    time_t ret=(time_t) DaysFromCivil(val[0],val[1],val[2])*86400+val[3]*3600+val[4]*60+val[5];
+    if (!withtz) return ret;
+
+    const char *tz=withtz+1;
+    len=strlen(tz);
+    if ((tz[0]=='+') || (tz[0]=='-'))
+    {
+        if (len==5)
+        {
+            int v=atoi(tz);
+            int h=v/100;
+            int m=v-(h*100);
+            ret-=h*3600+m*60;
+        }
+        return ret;
+    }
+    if (len>2) ret=LocalToUTC(tz,ret);
+    return ret;
+}
@@ -0,0 +1,64 @@
+/*
+ * tz.h: A plugin for the Video Disk Recorder
+ *
+ * See the README file for copyright information and how to reach the author.
+ *
+ */
+
+#ifndef _TZ_H
+#define _TZ_H
+
+#include <vdr/tools.h>
+#include <stdint.h>
+#include <time.h>
+
+#define ZONEINFO "/usr/share/zoneinfo"
+
+// days since 1970-01-01 of the given date (proleptic gregorian)
+long DaysFromCivil(int Year, int Month, int Day);
+
+class cXMLTVZone : public cListObject
+{
+private:
+    struct rule
+    {
+        int type; // 'J' julian 1..365, 'D' zero based day, 'M' month.week.day
+        int day;
+        int week;
+        int month;
+        int time;
+    };
+    char *name;
+    int timecnt;
+    int typecnt;
+    int64_t *transitions;
+    unsigned char *idxs;
+    int *utoffs;
+    bool hasfooter;
+    bool hasdst;
+    int stdoff;
+    int dstoff;
+    struct rule start;
+    struct rule end;
+    bool load();
+    bool parsefooter(const char *footer);
+    time_t ruletime(const struct rule *r, int year, int offset);
+    int utoff(time_t utc);
+public:
+    cXMLTVZone(const char *Name);
+    ~cXMLTVZone();
+    const char *Name()
+    {
+        return name;
+    }
+    time_t LocalToUTC(time_t Local);
+};
+
+class cXMLTVZones : public cList<cXMLTVZone>
+{
+public:
+    time_t LocalToUTC(const char *Name, time_t Local);
+    time_t ConvertXMLTVTime2UnixTime(const char *xmltvtime);
+};
+
+#endif
@@ -22,6 +22,7 @@
 
 #include "setup.h"
 #include "xmltv2vdr.h"
+#include "eplists.h"
 #include "debug.h"
 
 int ioprio_set(int which, int who, int ioprio)
@@ -277,6 +278,11 @@ cGlobals::cGlobals() : epgexecutor(EPGSources()),housekeeping(this)
     epall=0;
     order=strdup(GetDefaultOrder());
     imgdelafter=30;
+    parsethreads=0;
+    eplistscache=EPLISTSCACHE;
+    eplistsfuzzy=EPLISTSFUZZY;
+    dbprofile=DBPROFILE_STANDARD;
+    dbclustered=false;
     soundex=false;
 
 #if APIVERSNUM > 20101
@@ -449,6 +455,363 @@ void cGlobals::SetEPGFile(const char *EPGFile)
 }
 
 
+static void unlinkdbfiles(const char *File)
+{
+    // journal, write-ahead log and its index of a database
+    const char *suffixes[]= { "-journal","-wal","-shm" };
+    for (size_t i=0; i<sizeof(suffixes)/sizeof(suffixes[0]); i++)
+    {
+        char *name;
+        if (asprintf(&name,"%s%s",File,suffixes[i])==-1) continue;
+        unlink(name);
+        free(name);
+    }
+}
+
+int cGlobals::OpenDB(sqlite3 **Db, int Flags, int BusyTimeout)
+{
+    if (!Db) return SQLITE_MISUSE;
+    if (!epgfile)
+    {
+        *Db=NULL;
+        return SQLITE_CANTOPEN;
+    }
+    int ret=sqlite3_open_v2(epgfile,Db,Flags,NULL);
+    if (ret!=SQLITE_OK) return ret;
+    if (BusyTimeout>0) sqlite3_busy_timeout(*Db,BusyTimeout);
+
+    const char *pragmas;
+    switch (dbprofile)
+    {
+    case DBPROFILE_WAL:
+        pragmas="PRAGMA journal_mode=WAL;PRAGMA synchronous=NORMAL;"
+                "PRAGMA mmap_size=67108864;PRAGMA cache_size=-8192;PRAGMA temp_store=MEMORY;";
+        break;
+    case DBPROFILE_WALNOSYNC:
+        // only sensible if the database lives on a tmpfs
+        pragmas="PRAGMA journal_mode=WAL;PRAGMA synchronous=OFF;"
+                "PRAGMA mmap_size=268435456;PRAGMA cache_size=-16384;PRAGMA temp_store=MEMORY;";
+        break;
+    default:
+        // leave a write-ahead log from a former setting
+        pragmas="PRAGMA journal_mode=DELETE;";
+        break;
+    }
+    // switching the journal mode fails while others use the database,
+    // the next connection will try again
+    char *errmsg=NULL;
+    if (sqlite3_exec(*Db,pragmas,NULL,NULL,&errmsg)!=SQLITE_OK)
+    {
+        tsyslog("sqlite3: %s (tuning)",errmsg ? errmsg : "unknown error");
+    }
+    sqlite3_free(errmsg);
+    return SQLITE_OK;
+}
+
+int cGlobals::UnlinkDB()
+{
+    if (!epgfile)
+    {
+        errno=ENOENT;
+        return -1;
+    }
+    int ret=unlink(epgfile);
+    unlinkdbfiles(epgfile);
+    return ret;
+}
+
+static int dbversion(sqlite3 *Db)
+{
+    sqlite3_stmt *stmt;
+    if (sqlite3_prepare_v2(Db,"PRAGMA user_version",-1,&stmt,NULL)!=SQLITE_OK) return -1;
+    int version=-1;
+    if (sqlite3_step(stmt)==SQLITE_ROW) version=sqlite3_column_int(stmt,0);
+    sqlite3_finalize(stmt);
+    return version;
+}
+
+static int dbhas(sqlite3 *Db, const char *SQL)
+{
+    // returns 1 if the query returns a row, -1 on errors
+    sqlite3_stmt *stmt;
+    if (sqlite3_prepare_v2(Db,SQL,-1,&stmt,NULL)!=SQLITE_OK) return -1;
+    int ret=sqlite3_step(stmt);
+    sqlite3_finalize(stmt);
+    if (ret==SQLITE_ROW) return 1;
+    if (ret==SQLITE_DONE) return 0;
+    return -1;
+}
+
+static bool dbaddcolumn(sqlite3 *Db, const char *Name, const char *Type)
+{
+    sqlite3_stmt *stmt;
+    if (sqlite3_prepare_v2(Db,"PRAGMA table_info(epg)",-1,&stmt,NULL)!=SQLITE_OK) return false;
+    bool has=false;
+    int ret;
+    while ((ret=sqlite3_step(stmt))==SQLITE_ROW)
+    {
+        const char *name=(const char *) sqlite3_column_text(stmt,1);
+        if ((name) && (!strcasecmp(name,Name))) has=true;
+    }
+    sqlite3_finalize(stmt);
+    if (ret!=SQLITE_DONE) return false;
+    if (has) return true;
+    char *sql;
+    if (asprintf(&sql,"ALTER TABLE epg ADD COLUMN %s %s",Name,Type)==-1) return false;
+    ret=sqlite3_exec(Db,sql,NULL,NULL,NULL);
+    free(sql);
+    return (ret==SQLITE_OK);
+}
+
+// the secondary indexes of the current schema version
+static const char dbindexes[]="CREATE INDEX IF NOT EXISTS idx1 on epg (starttime, eiteventid, chid); " \
+                              "CREATE INDEX IF NOT EXISTS idx2 on epg (starttime, title, chid); " \
+                              "CREATE INDEX IF NOT EXISTS idx3 on epg (starttime, duration, srcid);" \
+                              "CREATE INDEX IF NOT EXISTS idx4 on epg (srcid, endtime, starttime);";
+
+static int dbwithoutrowid(sqlite3 *Db)
+{
+    return dbhas(Db,"SELECT 1 FROM sqlite_master WHERE type='table' AND name='epg' AND " \
+                 "sql LIKE '%WITHOUT ROWID%'");
+}
+
+static bool dbrebuild(sqlite3 *Db, bool Clustered)
+{
+    // copies epg into a table with a rowid or into one without, which is
+    // clustered by channel and starttime, the columns are those of the
+    // current schema version
+    const char cols[]="srcid,chid,eventid,eiteventid,starttime,duration,title,alttitle,origtitle," \
+                      "shorttext,description,eitdescription,country,year,credits,category,review," \
+                      "rating,starrating,video,audio,season,episode,episodeoverall,pics,srcidx,hash," \
+                      "epstamp,endtime";
+    char *sql;
+    if (asprintf(&sql,"DROP INDEX IF EXISTS idx0;" \
+                 "DROP INDEX IF EXISTS idx1;" \
+                 "DROP INDEX IF EXISTS idx2;" \
+                 "DROP INDEX IF EXISTS idx3;" \
+                 "DROP INDEX IF EXISTS idx4;" \
+                 "ALTER TABLE epg RENAME TO epg0;" \
+                 "CREATE TABLE epg (" \
+                 "srcid int, chid int, eventid int, eiteventid int, "\
+                 "starttime datetime, duration int, title nvarchar(255), alttitle nvarchar(255), "\
+                 "origtitle nvarchar(255), shorttext nvarchar(255), description text, "\
+                 "eitdescription text, country nvarchar(255), year int, " \
+                 "credits text, category text, review text, rating text, " \
+                 "starrating text, video text, audio text, season int, episode int, " \
+                 "episodeoverall int, pics text, srcidx int, hash int, epstamp int, endtime int," \
+                 "PRIMARY KEY(%s)" \
+                 ")%s;" \
+                 "INSERT INTO epg (%s) SELECT %s FROM epg0%s;" \
+                 "DROP TABLE epg0;" \
+                 "%s%s",
+                 Clustered ? "chid, starttime, srcid, eventid" : "eventid, srcid, chid",
+                 Clustered ? " WITHOUT ROWID" : "",cols,cols,
+                 Clustered ? " WHERE chid IS NOT NULL AND starttime IS NOT NULL AND " \
+                 "srcid IS NOT NULL AND eventid IS NOT NULL" : "",
+                 Clustered ? "CREATE UNIQUE INDEX idx0 on epg (eventid, srcid, chid);" : "",
+                 dbindexes)==-1)
+        return false;
+    int ret=sqlite3_exec(Db,sql,NULL,NULL,NULL);
+    free(sql);
+    return (ret==SQLITE_OK);
+}
+
+bool cGlobals::migratedb(sqlite3 *Db, int Version)
+{
+    // upgrades the epg.db from Version to Version+1
+    switch (Version)
+    {
+    case 0:
+    {
+        // unversioned databases got their columns over time, the next
+        // step copies all of them
+        static const char *columns[][2]=
+        {
+            { "eiteventid", "int" }, { "starttime", "datetime" }, { "duration", "int" },
+            { "title", "nvarchar(255)" }, { "alttitle", "nvarchar(255)" }, { "origtitle", "nvarchar(255)" },
+            { "shorttext", "nvarchar(255)" }, { "description", "text" }, { "eitdescription", "text" },
+            { "country", "nvarchar(255)" }, { "year", "int" }, { "credits", "text" }, { "category", "text" },
+            { "review", "text" }, { "rating", "text" }, { "starrating", "text" }, { "video", "text" },
+            { "audio", "text" }, { "season", "int" }, { "episode", "int" }, { "episodeoverall", "int" },
+            { "pics", "text" }, { "srcidx", "int" }, { "hash", "int" }, { "epstamp", "int" },
+            { NULL, NULL }
+        };
+        for (int i=0; columns[i][0]; i++)
+        {
+            if (!dbaddcolumn(Db,columns[i][0],columns[i][1])) return false;
+        }
+        return true;
+    }
+    case 1:
+    {
+        // sources and channels are stored once, epg refers to them by key
+        const char *sql="CREATE TABLE sources (srcid INTEGER PRIMARY KEY, src nvarchar(100) UNIQUE);" \
+                        "CREATE TABLE channels (chid INTEGER PRIMARY KEY, channelid nvarchar(255) UNIQUE);" \
+                        "INSERT INTO sources (src) SELECT DISTINCT src FROM epg WHERE src IS NOT NULL;" \
+                        "INSERT INTO channels (channelid) SELECT DISTINCT channelid FROM epg " \
+                        "WHERE channelid IS NOT NULL;" \
+                        "DROP INDEX IF EXISTS idx1;" \
+                        "DROP INDEX IF EXISTS idx2;" \
+                        "DROP INDEX IF EXISTS idx3;" \
+                        "ALTER TABLE epg RENAME TO epg1;" \
+                        "CREATE TABLE epg (" \
+                        "srcid int, chid int, eventid int, eiteventid int, "\
+                        "starttime datetime, duration int, title nvarchar(255), alttitle nvarchar(255), "\
+                        "origtitle nvarchar(255), shorttext nvarchar(255), description text, "\
+                        "eitdescription text, country nvarchar(255), year int, " \
+                        "credits text, category text, review text, rating text, " \
+                        "starrating text, video text, audio text, season int, episode int, " \
+                        "episodeoverall int, pics text, srcidx int, hash int, epstamp int," \
+                        "PRIMARY KEY(eventid, srcid, chid)" \
+                        ");" \
+                        "INSERT INTO epg SELECT srcid,chid,eventid,eiteventid,starttime,duration,title," \
+                        "alttitle,origtitle,shorttext,description,eitdescription,country,year,credits," \
+                        "category,review,rating,starrating,video,audio,season,episode,episodeoverall," \
+                        "pics,srcidx,hash,epstamp FROM epg1 JOIN sources USING (src) " \
+                        "JOIN channels USING (channelid);" \
+                        "DROP TABLE epg1;" \
+                        "CREATE INDEX idx1 on epg (starttime, eiteventid, chid); " \
+                        "CREATE INDEX idx2 on epg (starttime, title, chid); " \
+                        "CREATE INDEX idx3 on epg (starttime, duration, srcid);";
+        return (sqlite3_exec(Db,sql,NULL,NULL,NULL)==SQLITE_OK);
+    }
+    case 2:
+        // the end of the programme is stored for the import window and expiry
+        if (!dbaddcolumn(Db,"endtime","int")) return false;
+        return (sqlite3_exec(Db,"UPDATE epg SET endtime=starttime+duration;" \
+                             "CREATE INDEX idx4 on epg (srcid, endtime, starttime);",
+                             NULL,NULL,NULL)==SQLITE_OK);
+    default:
+        return false;
+    }
+}
+
+bool cGlobals::UpgradeDB(sqlite3 *Db)
+{
+    if (!Db) return false;
+    int version=dbversion(Db);
+    if (version>EPGDBVERSION)
+    {
+        // written by a newer plugin, leave it alone
+        esyslog("epg.db has schema version %i, expected %i",version,EPGDBVERSION);
+        return false;
+    }
+    if ((version==EPGDBVERSION) && (dbwithoutrowid(Db)==(dbclustered ? 1 : 0))) return true;
+
+    if (sqlite3_exec(Db,"BEGIN IMMEDIATE",NULL,NULL,NULL)!=SQLITE_OK)
+    {
+        esyslog("sqlite3: %s (upgrade)",sqlite3_errmsg(Db));
+        return false;
+    }
+    // someone else may have been faster
+    version=dbversion(Db);
+    int from=version;
+    int exists=dbhas(Db,"SELECT 1 FROM sqlite_master WHERE type='table' AND name='epg'");
+    bool ok=((version>=0) && (exists>=0));
+    if ((ok) && (!exists))
+    {
+        // the first versioned schema, the migrations do the rest
+        const char *sql="CREATE TABLE epg (" \
+                        "src nvarchar(100), channelid nvarchar(255), eventid int, eiteventid int, "\
+                        "starttime datetime, duration int, title nvarchar(255), alttitle nvarchar(255), "\
+                        "origtitle nvarchar(255), shorttext nvarchar(255), description text, "\
+                        "eitdescription text, country nvarchar(255), year int, " \
+                        "credits text, category text, review text, rating text, " \
+                        "starrating text, video text, audio text, season int, episode int, " \
+                        "episodeoverall int, pics text, srcidx int, hash int, epstamp int," \
+                        "PRIMARY KEY(eventid, src, channelid)" \
+                        ");" \
+                        "CREATE INDEX idx1 on epg (starttime, eiteventid, channelid); " \
+                        "CREATE INDEX idx2 on epg (starttime, title, channelid); " \
+                        "CREATE INDEX idx3 on epg (starttime, duration, src);";
+        ok=(sqlite3_exec(Db,sql,NULL,NULL,NULL)==SQLITE_OK);
+        if (ok) version=1;
+    }
+    while ((ok) && (version<EPGDBVERSION))
+    {
+        ok=migratedb(Db,version);
+        if (ok) version++;
+    }
+    // the layout of the table is a setup option
+    bool rebuilt=false;
+    if (ok)
+    {
+        int clustered=dbwithoutrowid(Db);
+        ok=(clustered>=0);
+        if ((ok) && (clustered!=(dbclustered ? 1 : 0)))
+        {
+            ok=dbrebuild(Db,dbclustered);
+            rebuilt=true;
+        }
+    }
+    if (ok)
+    {
+        char *sql;
+        if (asprintf(&sql,"PRAGMA user_version=%i",version)==-1) ok=false;
+        if (ok)
+        {
+            ok=(sqlite3_exec(Db,sql,NULL,NULL,NULL)==SQLITE_OK);
+            free(sql);
+        }
+    }
+    if ((!ok) || (sqlite3_exec(Db,"COMMIT",NULL,NULL,NULL)!=SQLITE_OK))
+    {
+        const char *msg=sqlite3_errmsg(Db);
+        esyslog("failed to upgrade epg.db schema from version %i: %s",from,msg);
+        bool schema=((exists==1) && ((strstr(msg,"has no column named")) || (strstr(msg,"no such column"))));
+        sqlite3_exec(Db,"ROLLBACK",NULL,NULL,NULL);
+        if (!schema) return false;
+        // a schema the migrations don't know, start with an empty one
+        esyslog("sqlite3: database schema changed, recreating epg.db!");
+        if (sqlite3_exec(Db,"BEGIN IMMEDIATE;" \
+                         "DROP TABLE IF EXISTS epg;" \
+                         "DROP TABLE IF EXISTS sources;" \
+                         "DROP TABLE IF EXISTS channels;" \
+                         "PRAGMA user_version=0;" \
+                         "COMMIT",NULL,NULL,NULL)!=SQLITE_OK)
+        {
+            esyslog("sqlite3: %s (recreate)",sqlite3_errmsg(Db));
+            sqlite3_exec(Db,"ROLLBACK",NULL,NULL,NULL);
+            return false;
+        }
+        return UpgradeDB(Db);
+    }
+    if ((exists) && (from!=version))
+        isyslog("upgraded epg.db schema from version %i to %i",from,version);
+    if ((exists) && (rebuilt))
+        isyslog("rebuilt epg table %s",dbclustered ? "clustered by channel and starttime" : "with rowid");
+    return true;
+}
+
+bool cGlobals::DropDBIndexes(sqlite3 *Db)
+{
+    // idx0 stays, it's the unique key of the clustered table
+    return (sqlite3_exec(Db,"DROP INDEX IF EXISTS idx1;" \
+                         "DROP INDEX IF EXISTS idx2;" \
+                         "DROP INDEX IF EXISTS idx3;" \
+                         "DROP INDEX IF EXISTS idx4;",NULL,NULL,NULL)==SQLITE_OK);
+}
+
+bool cGlobals::CreateDBIndexes(sqlite3 *Db)
+{
+    return (sqlite3_exec(Db,dbindexes,NULL,NULL,NULL)==SQLITE_OK);
+}
+
+bool cGlobals::UpgradeDB()
+{
+    if (!DBExists()) return true; // created on the first import
+    sqlite3 *db=NULL;
+    if (OpenDB(&db,SQLITE_OPEN_READWRITE)!=SQLITE_OK)
+    {
+        esyslog("failed to open %s",epgfile);
+        sqlite3_close(db);
+        return false;
+    }
+    bool ret=UpgradeDB(db);
+    sqlite3_close(db);
+    return ret;
+}
+
 void cGlobals::CopyEPGFile(bool Init)
 {
     if ((!epgfile) || (!epgfile_store)) return;
@@ -462,9 +825,22 @@ void cGlobals::CopyEPGFile(bool Init)
     {
         if (stat(epgfile_store,&statbuf)==-1) return; // no file?
         fd=open(epgfile_store,O_RDONLY);
+        // a stale log would be applied to the copy
+        unlinkdbfiles(epgfile);
     }
     else
     {
+        // move the write-ahead log into the database first
+        sqlite3 *db=NULL;
+        if (sqlite3_open_v2(epgfile,&db,SQLITE_OPEN_READWRITE,NULL)==SQLITE_OK)
+        {
+            sqlite3_busy_timeout(db,DBBUSYTIMEOUT);
+            if (sqlite3_exec(db,"PRAGMA wal_checkpoint(TRUNCATE);",NULL,NULL,NULL)!=SQLITE_OK)
+            {
+                esyslog("failed to checkpoint %s",epgfile);
+            }
+        }
+        sqlite3_close(db);
         if (stat(epgfile,&statbuf)==-1) return;
         fd=open(epgfile,O_RDONLY);
     }
@@ -571,6 +947,20 @@ void cGlobals::SetEPDir(const char* EPDir)
     }
 }
 
+void cGlobals::SetEPListsCache(int Value)
+{
+    if (Value<1) Value=EPLISTSCACHE;
+    eplistscache=Value;
+    EPLists.SetCacheSize(Value);
+}
+
+void cGlobals::SetEPListsFuzzy(int Value)
+{
+    if ((Value<0) || (Value>100)) Value=EPLISTSFUZZY;
+    eplistsfuzzy=Value;
+    EPLists.SetFuzzy(Value);
+}
+
 bool cGlobals::DBExists()
 {
     if (!epgfile) return true; // is this safe?
@@ -923,6 +1313,17 @@ void cMainThread::Action(void)
              }
          }
 
+         if (global->EPDir() && global->EPGSeasonEpisode())
+         {
+             if (now>=(global->EPGSeasonEpisode()->Last()+600))
+             {
+                 if (!global->EPGSeasonEpisode()->Active() && !global->epgexecutor.Active())
+                 {
+                     global->EPGSeasonEpisode()->Start();
+                 }
+             }
+         }
+
          if (now>(global->housekeeping.Last()+3600))
          {
              if (!global->housekeeping.Active())
@@ -940,6 +1341,7 @@ cHouseKeeping::cHouseKeeping(cGlobals *Global): cThread("xmltv2vdr housekeeping"
 {
     global=Global;
     last_housetime_t = time(NULL);
+    rebuildepindex=false;
 }
 
 void cHouseKeeping::checkdir(const char* imgdir, int age, int &cnt, int &lcnt)
@@ -992,6 +1394,11 @@ int sd_select(const dirent* dirent)
 void cHouseKeeping::Action()
 {
     last_housetime_t=(time(NULL) / 3600)*3600;
+    if (global->EPDir())
+    {
+        EPLists.UpdateIndex(rebuildepindex);
+        rebuildepindex=false;
+    }
     if (global->ImgDelAfter() && global->ImgDir())
     {
         int cnt=0,lcnt=0;
@@ -1030,10 +1437,13 @@ void cHouseKeeping::Action()
 #endif
 
     sqlite3 *db=NULL;
-    if (sqlite3_open_v2(global->EPGFile(),&db,SQLITE_OPEN_READWRITE,NULL)==SQLITE_OK)
+    if (global->OpenDB(&db,SQLITE_OPEN_READWRITE)==SQLITE_OK)
     {
         char *sql;
-        if (asprintf(&sql,"delete from epg where ((starttime+duration) < %li)",time(NULL))!=-1)
+        // by source, so the end time index is used. Rows of a source
+        // missing in sources would never expire, but sources are only
+        // added and epg refers to them by key
+        if (asprintf(&sql,EPGDBEXPIRESQL,time(NULL))!=-1)
         {
             char *errmsg;
             if (sqlite3_exec(db,sql,NULL,NULL,&errmsg)!=SQLITE_OK)
@@ -1060,12 +1470,231 @@ void cHouseKeeping::Action()
 
 cEPGSeasonEpisode::cEPGSeasonEpisode(cGlobals *Global): cThread("xmltv2vdr seasonepisode")
 {
-    epgfile=Global->EPGFile();
+    global=Global;
+    last_run_t=0;
+}
+
+time_t cEPGSeasonEpisode::filetime(const char *Title)
+{
+    // modification time of the eplists file for this title, 0 if there is none
+    char *ftitle=NULL;
+    const char *suffix;
+    if (!EPLists.Find(global->EPDir(),Title,&ftitle,&suffix)) return 0;
+    if (!ftitle) return 0;
+    int idx=files.Find(ftitle);
+    if (idx>=0)
+    {
+        free(ftitle);
+        return mtimes[idx];
+    }
+    time_t mtime=0;
+    char *epfile;
+    if (asprintf(&epfile,"%s/%s%s",global->EPDir(),ftitle,suffix)!=-1)
+    {
+        struct stat statbuf;
+        if (stat(epfile,&statbuf)!=-1) mtime=statbuf.st_mtime;
+        free(epfile);
+    }
+    files.Append(ftitle);
+    mtimes.Append(mtime);
+    return mtime;
+}
+
+int cEPGSeasonEpisode::fetch(sqlite3 *Db, struct key &Last, iconv_t cEP2ASCII, iconv_t cUTF2ASCII,
+                             struct update *Updates, int &Rows, int &Count, int &NotFound)
+{
+    // reads the next batch of rows and looks up those, whose eplists file
+    // changed after they were written
+    const char sql[]="SELECT eventid,srcid,chid,src,channelid,title,shorttext,description,season," \
+                     "episode,episodeoverall,epstamp FROM epg JOIN sources USING (srcid) " \
+                     "JOIN channels USING (chid) WHERE (eventid,srcid,chid)>(?1,?2,?3) AND " \
+                     "endtime>=?4 ORDER BY eventid,srcid,chid LIMIT ?5";
+    sqlite3_stmt *stmt;
+    Rows=Count=NotFound=0;
+    int ret=sqlite3_prepare_v2(Db,sql,-1,&stmt,NULL);
+    if (ret!=SQLITE_OK)
+    {
+        esyslog("%i %s (sefetch)",ret,sqlite3_errmsg(Db));
+        return ret;
+    }
+    sqlite3_bind_int64(stmt,1,Last.eventid);
+    sqlite3_bind_int64(stmt,2,Last.srcid);
+    sqlite3_bind_int64(stmt,3,Last.chid);
+    sqlite3_bind_int64(stmt,4,(sqlite3_int64) time(NULL));
+    sqlite3_bind_int(stmt,5,EPBACKFILLBATCH);
+
+    time_t now=time(NULL);
+    while ((ret=sqlite3_step(stmt))==SQLITE_ROW)
+    {
+        Rows++;
+        Last.eventid=sqlite3_column_int64(stmt,0);
+        Last.srcid=sqlite3_column_int64(stmt,1);
+        Last.chid=sqlite3_column_int64(stmt,2);
+        const char *title=(const char *) sqlite3_column_text(stmt,5);
+        time_t mtime=filetime(title);
+        if (!mtime) continue;
+        if (mtime<=(time_t) sqlite3_column_int64(stmt,11)) continue;
+
+        const char *src=(const char *) sqlite3_column_text(stmt,3);
+        bool useeptext;
+        if (src && !strcmp(src,EITSOURCE))
+        {
+            useeptext=((global->EPAll() & EPLIST_USE_STEXTITLE)==EPLIST_USE_STEXTITLE);
+        }
+        else
+        {
+            cEPGMapping *map=global->EPGMappings()->GetMap(
+                                 tChannelID::FromString((const char *) sqlite3_column_text(stmt,4)));
+            useeptext=(map && ((map->Flags() & OPT_SEASON_STEXTITLE)==OPT_SEASON_STEXTITLE));
+        }
+
+        struct update *u=&Updates[Count++];
+        u->key=Last;
+        u->stamp=now;
+        u->shorttext=u->alttitle=NULL;
+        int season=sqlite3_column_int(stmt,8),episode=sqlite3_column_int(stmt,9),episodeoverall=0;
+        u->season=season;
+        u->episode=episode;
+        u->episodeoverall=sqlite3_column_int(stmt,10);
+
+        // same as importing the event from the xmltv file
+        char *epshorttext=NULL,*eptitle=NULL;
+        if (cParse::FetchSeasonEpisode(cEP2ASCII,cUTF2ASCII,global->EPDir(),title,
+                                       (const char *) sqlite3_column_text(stmt,6),
+                                       (const char *) sqlite3_column_text(stmt,7),
+                                       season,episode,episodeoverall,&epshorttext,&eptitle,&NotFound))
+        {
+            u->season=season;
+            u->episode=episode;
+            u->episodeoverall=episodeoverall;
+            if (useeptext)
+            {
+                u->shorttext=epshorttext;
+                epshorttext=NULL;
+            }
+        }
+        if (useeptext)
+        {
+            u->alttitle=eptitle;
+            eptitle=NULL;
+        }
+        free(epshorttext);
+        free(eptitle);
+    }
+    sqlite3_finalize(stmt);
+    if (ret!=SQLITE_DONE)
+    {
+        if (ret!=SQLITE_BUSY) esyslog("%i %s (sefetch)",ret,sqlite3_errmsg(Db));
+        return ret;
+    }
+    return SQLITE_OK;
+}
+
+int cEPGSeasonEpisode::store(sqlite3 *Db, struct update *Updates, int Count)
+{
+    // one short transaction per batch, so other writers only wait for a moment
+    int ret=sqlite3_exec(Db,"BEGIN IMMEDIATE",NULL,NULL,NULL);
+    if (ret!=SQLITE_OK) return ret;
+
+    const char sql[]="UPDATE epg SET season=?1,episode=?2,episodeoverall=?3," \
+                     "shorttext=COALESCE(?4,shorttext),alttitle=COALESCE(?5,alttitle)," \
+                     "epstamp=?6 WHERE eventid=?7 AND srcid=?8 AND chid=?9";
+    sqlite3_stmt *stmt;
+    ret=sqlite3_prepare_v2(Db,sql,-1,&stmt,NULL);
+    if (ret!=SQLITE_OK)
+    {
+        esyslog("%i %s (sestore)",ret,sqlite3_errmsg(Db));
+        sqlite3_exec(Db,"ROLLBACK",NULL,NULL,NULL);
+        return ret;
+    }
+    for (int i=0; i<Count; i++)
+    {
+        sqlite3_bind_int(stmt,1,Updates[i].season);
+        sqlite3_bind_int(stmt,2,Updates[i].episode);
+        sqlite3_bind_int(stmt,3,Updates[i].episodeoverall);
+        sqlite3_bind_text(stmt,4,Updates[i].shorttext,-1,SQLITE_STATIC);
+        sqlite3_bind_text(stmt,5,Updates[i].alttitle,-1,SQLITE_STATIC);
+        sqlite3_bind_int64(stmt,6,(sqlite3_int64) Updates[i].stamp);
+        sqlite3_bind_int64(stmt,7,Updates[i].key.eventid);
+        sqlite3_bind_int64(stmt,8,Updates[i].key.srcid);
+        sqlite3_bind_int64(stmt,9,Updates[i].key.chid);
+        ret=sqlite3_step(stmt);
+        sqlite3_reset(stmt);
+        if (ret!=SQLITE_DONE) break;
+        ret=SQLITE_OK;
+    }
+    sqlite3_finalize(stmt);
+    if (ret==SQLITE_OK) ret=sqlite3_exec(Db,"COMMIT",NULL,NULL,NULL);
+    if (ret!=SQLITE_OK)
+    {
+        if (ret!=SQLITE_BUSY) esyslog("%i %s (sestore)",ret,sqlite3_errmsg(Db));
+        sqlite3_exec(Db,"ROLLBACK",NULL,NULL,NULL);
+    }
+    return ret;
 }
 
 void cEPGSeasonEpisode::Action()
 {
-    // TODO: update season, episode, episodeoverall fields in db
+    // refreshes season, episode, episodeoverall and shorttext of all
+    // events in the db, whose eplists file changed since they were written
+    last_run_t=(time(NULL)/600)*600;
+    if (!global->EPDir()) return;
+    if (!global->DBExists()) return;
+    if (global->epgexecutor.Active()) return;
+
+    SetPriority(19);
+    SetIOPriority(7);
+
+    iconv_t cep2ascii=iconv_open("ASCII//TRANSLIT",global->EPCodeset());
+    iconv_t cutf2ascii=iconv_open("ASCII//TRANSLIT","UTF-8");
+    struct update *updates=(struct update *) calloc(EPBACKFILLBATCH,sizeof(struct update));
+    sqlite3 *db=NULL;
+    if ((cep2ascii!=(iconv_t) -1) && (cutf2ascii!=(iconv_t) -1) && (updates) &&
+            (global->OpenDB(&db,SQLITE_OPEN_READWRITE,50)==SQLITE_OK))
+    {
+        files.Clear();
+        mtimes.Clear();
+
+        struct key last= { -1,-1,-1 };
+        // misses are logged once per run, not for every event
+        int busy=0,refreshed=0,notfound=0;
+        while (Running())
+        {
+            // the importer always goes first
+            if (global->epgexecutor.Active()) break;
+            struct key next=last;
+            int rows,count,missed;
+            int ret=fetch(db,next,cep2ascii,cutf2ascii,updates,rows,count,missed);
+            if ((ret==SQLITE_OK) && (count)) ret=store(db,updates,count);
+            for (int i=0; i<count; i++)
+            {
+                free(updates[i].shorttext);
+                free(updates[i].alttitle);
+            }
+            if (ret==SQLITE_BUSY)
+            {
+                // try the same batch again later
+                if (++busy>10) break;
+                cCondWait::SleepMs(10*EPBACKFILLPAUSE);
+                continue;
+            }
+            if (ret!=SQLITE_OK) break;
+            busy=0;
+            refreshed+=count;
+            notfound+=missed;
+            if (rows<EPBACKFILLBATCH) break;
+            last=next;
+            if (count) cCondWait::SleepMs(EPBACKFILLPAUSE);
+        }
+        if (refreshed) isyslog("refreshed season/episode of %i events",refreshed);
+        if (notfound) isyslog("failed to find %i events in eplists",notfound);
+        files.Clear();
+        mtimes.Clear();
+    }
+    if (db) sqlite3_close(db);
+    free(updates);
+    if (cep2ascii!=(iconv_t) -1) iconv_close(cep2ascii);
+    if (cutf2ascii!=(iconv_t) -1) iconv_close(cutf2ascii);
 }
 
 // -------------------------------------------------------------
@@ -1150,7 +1779,7 @@ void cPluginXmltv2vdr::GetSqliteCompileOptions()
 int cPluginXmltv2vdr::GetLastImportSource()
 {
     sqlite3 *db=NULL;
-    if (sqlite3_open_v2(g.EPGFile(),&db,SQLITE_OPEN_READWRITE,NULL)!=SQLITE_OK) return -1;
+    if (g.OpenDB(&db,SQLITE_OPEN_READWRITE)!=SQLITE_OK) return -1;
 
     char sql[]="select srcidx from epg where srcidx<>99 order by starttime desc limit 1";
     sqlite3_stmt *stmt;
@@ -1242,9 +1871,16 @@ bool cPluginXmltv2vdr::Start(void)
     isyslog("using file '%s' for epg database (storage)",g.EPGFileStore());
     isyslog("using file '%s' for epg database (runtime)",g.EPGFile());
     g.CopyEPGFile(true);
+    g.UpgradeDB();
     if (g.EPDir())
     {
         isyslog("using dir '%s' (%s) for episodes",g.EPDir(),g.EPCodeset());
+        char *epindex;
+        if (asprintf(&epindex,"%s/%s",g.ConfDir(),EPINDEXFILE)!=-1)
+        {
+            EPLists.SetIndex(epindex,g.EPDir(),g.EPCodeset());
+            free(epindex);
+        }
         g.AllocateEPGSeasonThread();
     }
     if (g.EPAll())
@@ -1339,6 +1975,26 @@ bool cPluginXmltv2vdr::SetupParse(const char *Name, const char *Value)
     {
         g.SetImgDelAfter(atoi(Value));
     }
+    else if (!strcasecmp(Name,"options.parsethreads"))
+    {
+        g.SetParseThreads(atoi(Value));
+    }
+    else if (!strcasecmp(Name,"options.eplistscache"))
+    {
+        g.SetEPListsCache(atoi(Value));
+    }
+    else if (!strcasecmp(Name,"options.eplistsfuzzy"))
+    {
+        g.SetEPListsFuzzy(atoi(Value));
+    }
+    else if (!strcasecmp(Name,"options.dbprofile"))
+    {
+        g.SetDBProfile(atoi(Value));
+    }
+    else if (!strcasecmp(Name,"options.dbclustered"))
+    {
+        g.SetDBClustered((bool) atoi(Value));
+    }
     else if (!strcasecmp(Name,"options.order"))
     {
         g.SetOrder(Value);
@@ -1370,6 +2026,8 @@ const char **cPluginXmltv2vdr::SVDRPHelpPages(void)
         "    Start housekeeping manually\n",
         "TIMR\n"
         "    Start timerthread manually\n",
+        "EPIX\n"
+        "    Rebuild episode index (starts housekeeping)\n",
         NULL
     };
     return HelpPages;
@@ -1421,7 +2079,7 @@ cString cPluginXmltv2vdr::SVDRPCommand(const char *Command, const char *Option,
     {
         if (g.EPGFile())
         {
-            if (unlink(g.EPGFile())==-1)
+            if (g.UnlinkDB()==-1)
             {
                 ReplyCode=550;
                 output="failed to delete database\n";
@@ -1474,6 +2132,26 @@ cString cPluginXmltv2vdr::SVDRPCommand(const char *Command, const char *Option,
             output="system busy\n";
         }
     }
+    if (!strcasecmp(Command,"EPIX"))
+    {
+        if (!g.EPDir())
+        {
+            ReplyCode=550;
+            output="no episodes dir\n";
+        }
+        else if (!g.epgexecutor.Active() && !g.housekeeping.Active())
+        {
+            g.housekeeping.RebuildEPIndex();
+            g.housekeeping.Start();
+            ReplyCode=250;
+            output="episode index rebuild started\n";
+        }
+        else
+        {
+            ReplyCode=550;
+            output="system busy\n";
+        }
+    }
     return output;
 }
 
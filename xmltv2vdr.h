@@ -145,9 +145,14 @@ class cHouseKeeping : public cThread
 private:
     cGlobals *global;
     time_t last_housetime_t;
+    bool rebuildepindex;
     void checkdir(const char *imgdir, int age, int &cnt, int &lcnt);
 public:
     cHouseKeeping(cGlobals *Global);
+    void RebuildEPIndex()
+    {
+        rebuildepindex=true;
+    }
     void Stop()
     {
         Cancel(3);
@@ -173,19 +178,73 @@ public:
     virtual void Action();
 };
 
+// rows per transaction of the season/episode backfill
+#define EPBACKFILLBATCH 100
+// pause between two batches in ms
+#define EPBACKFILLPAUSE 100
+
 class cEPGSeasonEpisode : public cThread
 {
 private:
-    const char *epgfile;
+    struct key
+    {
+        // unique in both layouts of the epg table, the clustered one has no rowid
+        sqlite3_int64 eventid,srcid,chid;
+    };
+    struct update
+    {
+        struct key key;
+        int season,episode,episodeoverall;
+        char *shorttext;
+        char *alttitle;
+        time_t stamp;
+    };
+    cGlobals *global;
+    time_t last_run_t;
+    cStringList files;
+    cVector<time_t> mtimes;
+    time_t filetime(const char *Title);
+    int fetch(sqlite3 *Db, struct key &Last, iconv_t cEP2ASCII, iconv_t cUTF2ASCII,
+              struct update *Updates, int &Rows, int &Count, int &NotFound);
+    int store(sqlite3 *Db, struct update *Updates, int Count);
 public:
     cEPGSeasonEpisode(cGlobals *Global);
     void Stop()
     {
         Cancel(3);
     }
+    time_t Last()
+    {
+        return last_run_t;
+    }
     virtual void Action();
 };
 
+// tuning applied on every connection to the epg.db
+enum
+{
+    DBPROFILE_STANDARD=0,
+    DBPROFILE_WAL,
+    DBPROFILE_WALNOSYNC,
+    DBPROFILES
+};
+
+// milliseconds a connection waits for a locked epg.db
+#define DBBUSYTIMEOUT 5000
+
+// schema version of the epg.db, stored as PRAGMA user_version
+#define EPGDBVERSION 3
+
+// the expiry of old programmes (now) and the import window of a source
+// (source name, begin, end), both are range searches on idx4
+#define EPGDBEXPIRESQL "delete from epg where srcid in (select srcid from sources) and endtime < %li"
+#define EPGDBWINDOWSQL "select channels.channelid,eventid,starttime,duration,title,origtitle,shorttext," \
+                       "description,country,year,credits,category,review,rating,starrating,video,audio," \
+                       "season,episode,episodeoverall,pics,sources.src,eiteventid,eitdescription " \
+                       "from epg join channels using (chid) join sources using (srcid) " \
+                       "where epg.srcid=(select srcid from sources where src='%s') " \
+                       "and endtime > %li and endtime < %li order by channels.channelid,starttime;"
+
 class cGlobals
 {
 private:
@@ -201,6 +260,11 @@ private:
     char *srcorder;
     int epall;
     int imgdelafter;
+    int parsethreads;
+    int eplistscache;
+    int eplistsfuzzy;
+    int dbprofile;
+    bool dbclustered;
     bool wakeup;
     bool soundex;
     cEPGMappings epgmappings;
@@ -208,6 +272,7 @@ private:
     cEPGSources epgsources;
     cEPGTimer *epgtimer;
     cEPGSeasonEpisode *epgseasonepisode;
+    bool migratedb(sqlite3 *Db, int Version);
 public:
     cGlobals();
     ~cGlobals();
@@ -260,6 +325,12 @@ public:
     {
         return epgfile;
     }
+    int OpenDB(sqlite3 **Db, int Flags, int BusyTimeout=DBBUSYTIMEOUT);
+    int UnlinkDB();
+    bool UpgradeDB();
+    bool UpgradeDB(sqlite3 *Db);
+    bool DropDBIndexes(sqlite3 *Db);
+    bool CreateDBIndexes(sqlite3 *Db);
     const char *EPGFileStore()
     {
         return epgfile_store;
@@ -290,6 +361,41 @@ public:
     {
         return imgdelafter;
     }
+    void SetParseThreads(int Value)
+    {
+        parsethreads=Value;
+    }
+    int ParseThreads()
+    {
+        return parsethreads;
+    }
+    void SetEPListsCache(int Value);
+    int EPListsCache()
+    {
+        return eplistscache;
+    }
+    void SetEPListsFuzzy(int Value);
+    int EPListsFuzzy()
+    {
+        return eplistsfuzzy;
+    }
+    void SetDBProfile(int Value)
+    {
+        if ((Value<0) || (Value>=DBPROFILES)) Value=DBPROFILE_STANDARD;
+        dbprofile=Value;
+    }
+    int DBProfile()
+    {
+        return dbprofile;
+    }
+    void SetDBClustered(bool Value)
+    {
+        dbclustered=Value;
+    }
+    bool DBClustered()
+    {
+        return dbclustered;
+    }
     void SetSrcOrder(const char *NewOrder)
     {
         free(srcorder);